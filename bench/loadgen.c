@@ -0,0 +1,195 @@
+/* loadgen.c ; Xlib load generator for benchmarking MaWiM
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "mawimctl.h"
+#include "mawimctl_client.h"
+
+#include <X11/Xlib.h>
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* How long to wait for MaWiM to react to a single window */
+#define LOADGEN_TIMEOUT_MS 2000
+
+/* Geometry requested by the load generator, chosen so that MaWiM will never
+ * configure a window to it by itself.
+ */
+#define LOADGEN_REQ_X 5
+#define LOADGEN_REQ_Y 7
+#define LOADGEN_REQ_WIDTH 13
+#define LOADGEN_REQ_HEIGHT 17
+
+void panic(char *msg) {
+  fprintf(stderr, "loadgen panic'd: %s\n", msg);
+  exit(EXIT_FAILURE);
+}
+
+double now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+int compare_doubles(const void *a, const void *b) {
+  double da = *(const double *)a;
+  double db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+double percentile(double *sorted, int count, double p) {
+  if (count == 0) {
+    return 0;
+  }
+
+  int ix = (int)(p / 100.0 * (count - 1) + 0.5);
+  return sorted[ix];
+}
+
+void report(char *phase, int count, int timeouts, double elapsed_ms,
+            double *latencies) {
+  qsort(latencies, count, sizeof(*latencies), compare_doubles);
+
+  printf("%-5s %6d windows in %9.2fms (%9.1f windows/s) | latency ms: p50 "
+         "%.3f p90 %.3f p99 %.3f max %.3f | timeouts %d\n",
+         phase, count, elapsed_ms, count / (elapsed_ms / 1000.0),
+         percentile(latencies, count, 50), percentile(latencies, count, 90),
+         percentile(latencies, count, 99), percentile(latencies, count, 100),
+         timeouts);
+}
+
+/* Waits for an event of the given type on the given window */
+bool wait_for(Display *display, Window window, int type) {
+  double deadline = now_ms() + LOADGEN_TIMEOUT_MS;
+  XEvent event;
+
+  while (true) {
+    while (XPending(display) > 0) {
+      XNextEvent(display, &event);
+      if (event.type == type && event.xany.window == window) {
+        return true;
+      }
+    }
+
+    int remaining = (int)(deadline - now_ms());
+    if (remaining <= 0) {
+      return false;
+    }
+
+    struct pollfd pfd = {.fd = ConnectionNumber(display), .events = POLLIN};
+    poll(&pfd, 1, remaining);
+  }
+}
+
+bool ctl_command(mawimctl_connection_t *connection, uint8_t id, uint8_t *data,
+                 uint16_t data_length) {
+  mawimctl_command_t cmd = {.command_identifier = id,
+                            .flags = 0,
+                            .data_length = data_length,
+                            .data = data};
+  mawimctl_response_t resp;
+
+  if (!mawimctl_client_send_command(connection, cmd) ||
+      !mawimctl_read_response(connection, &resp)) {
+    return false;
+  }
+
+  return resp.status == MAWIMCTL_OK;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: loadgen <window count> [workspace count]\n");
+    return 1;
+  }
+
+  int count = atoi(argv[1]);
+  int workspaces = argc > 2 ? atoi(argv[2]) : 1;
+  if (count < 1 || workspaces < 1 || workspaces > UINT8_MAX) {
+    panic("invalid arguments!");
+  }
+
+  Display *display = XOpenDisplay(NULL);
+  if (display == NULL) {
+    panic("could not open a X display!");
+  }
+
+  mawimctl_connection_t *connection =
+      mawimctl_client_connect(getenv("MAWIMCTL_SOCK"));
+  if (connection == NULL) {
+    panic("could not connect to mawimctl!");
+  }
+
+  Window *windows = malloc(count * sizeof(*windows));
+  double *latencies = malloc(count * sizeof(*latencies));
+  if (windows == NULL || latencies == NULL) {
+    panic("unable to allocate memory!");
+  }
+
+  Window root = DefaultRootWindow(display);
+  int per_workspace = (count + workspaces - 1) / workspaces;
+  int timeouts = 0;
+
+  /* Open, a window counts as managed once MaWiM configured it */
+  double start = now_ms();
+  for (int ix = 0; ix < count; ix++) {
+    if (ix % per_workspace == 0) {
+      uint8_t workspace = ix / per_workspace + 1;
+      if (!ctl_command(connection, MAWIMCTL_SET_WORKSPACE, &workspace, 1)) {
+        panic("failed to switch workspace!");
+      }
+    }
+
+    double op_start = now_ms();
+
+    windows[ix] = XCreateSimpleWindow(display, root, 0, 0, 1, 1, 0, 0, 0);
+    XSelectInput(display, windows[ix], StructureNotifyMask);
+    XMoveResizeWindow(display, windows[ix], LOADGEN_REQ_X, LOADGEN_REQ_Y,
+                      LOADGEN_REQ_WIDTH, LOADGEN_REQ_HEIGHT);
+    XMapWindow(display, windows[ix]);
+    XFlush(display);
+
+    if (!wait_for(display, windows[ix], ConfigureNotify)) {
+      timeouts++;
+    }
+
+    latencies[ix] = now_ms() - op_start;
+  }
+  report("open", count, timeouts, now_ms() - start, latencies);
+
+  /* Close, the mawimctl round trip is only answered once MaWiM went through
+   * the DestroyNotify queued before it.
+   */
+  timeouts = 0;
+  start = now_ms();
+  for (int ix = 0; ix < count; ix++) {
+    double op_start = now_ms();
+
+    XDestroyWindow(display, windows[ix]);
+    XSync(display, false);
+
+    if (!ctl_command(connection, MAWIMCTL_GET_WORKSPACE, NULL, 0)) {
+      timeouts++;
+    }
+
+    latencies[ix] = now_ms() - op_start;
+  }
+  report("close", count, timeouts, now_ms() - start, latencies);
+
+  free(windows);
+  free(latencies);
+  mawimctl_client_disconnect(connection);
+  XCloseDisplay(display);
+
+  return 0;
+}
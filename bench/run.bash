@@ -0,0 +1,39 @@
+#!/bin/bash
+# Runs the MaWiM scaling benchmark against a headless Xvfb server.
+# Expects mawim and the load generator to be built already, see the bench
+# target in build.mb.
+
+BENCH_DISPLAY=${BENCH_DISPLAY:-':102'}
+BENCH_RESOLUTION=${BENCH_RESOLUTION:-'1920x1080x24'}
+BENCH_SIZES=${BENCH_SIZES:-'10 100 1000 5000'}
+BENCH_WORKSPACES=${BENCH_WORKSPACES:-'2'}
+
+MAWIM_BIN=${MAWIM_BIN:-'build/release/mawim'}
+LOADGEN_BIN=${LOADGEN_BIN:-'build/bench/loadgen'}
+
+MAWIMCTL_SOCK="/tmp/mawim.bench.${BENCH_DISPLAY#:}.socket"
+export MAWIMCTL_SOCK
+
+if ! command -v Xvfb > /dev/null; then
+  echo "Xvfb is required to run the benchmark!"
+  exit 127
+fi
+
+for size in $BENCH_SIZES; do
+  echo "==> $size windows on $BENCH_WORKSPACES workspace(s)"
+
+  Xvfb $BENCH_DISPLAY -screen 0 $BENCH_RESOLUTION -nolisten tcp 2> /dev/null &
+  xvfb_pid=$!
+  sleep 1
+
+  DISPLAY=$BENCH_DISPLAY $MAWIM_BIN --verbosity=3 &
+  mawim_pid=$!
+  sleep 1
+
+  DISPLAY=$BENCH_DISPLAY $LOADGEN_BIN $size $BENCH_WORKSPACES
+
+  echo "peak rss: $(grep VmHWM /proc/$mawim_pid/status | awk '{print $2 " " $3}')"
+
+  kill $mawim_pid $xvfb_pid
+  wait $mawim_pid $xvfb_pid 2> /dev/null
+done
@@ -16,6 +16,7 @@
 #define MAWIMCTL_VERSION "1.0"
 
 #define MAWIMCTL_DEFAULT_SOCK_LOCATION "/tmp/mawim.control.socket"
+#define MAWIMCTL_DEFAULT_STATE_PAGE_NAME "/mawim.state"
 #define MAWIMCTL_FLAG_NO_RESPONSE 0b10000000
 
 enum mawimctl_cmd_id {
@@ -25,6 +26,10 @@ enum mawimctl_cmd_id {
   MAWIMCTL_RELOAD,
   MAWIMCTL_CLOSE_FOCUSED,
   MAWIMCTL_MOVE_FOCUSED_TO_WORKSPACE,
+  MAWIMCTL_GET_TRACE,
+  MAWIMCTL_GET_METRICS,
+  MAWIMCTL_SUBSCRIBE,
+  MAWIMCTL_GET_STATE,
 
   /* Has to be last value */
   MAWIMCTL_CMD_INVALID,
@@ -39,6 +44,10 @@ enum mawimctl_status {
   MAWIMCTL_CONFIG_MALFORMED,
   MAWIMCTL_NO_WINDOW_FOCUSED,
   MAWIMCTL_INTENRAL_ERROR,
+  MAWIMCTL_TRACING_DISABLED,
+
+  /* Not a response, the message is a mawimctl_event_t pushed to a subscriber */
+  MAWIMCTL_EVENT,
 
   /* Has to be last value */
   MAWIMCTL_STATUS_INVALID,
@@ -68,6 +77,130 @@ typedef struct mawimctl_response {
 
 typedef uint8_t mawimctl_workspaceid_t;
 
+enum mawimctl_event_type {
+  MAWIMCTL_EVENT_WORKSPACE_SWITCHED = 0,
+  MAWIMCTL_EVENT_WINDOW_MANAGED,
+  MAWIMCTL_EVENT_WINDOW_UNMANAGED,
+  MAWIMCTL_EVENT_FOCUS_CHANGED,
+  MAWIMCTL_EVENT_WINDOW_MOVED,
+
+  /* Has to be last value */
+  MAWIMCTL_EVENT_TYPE_INVALID,
+};
+
+#define MAWIMCTL_EVENT_MASK(type) (1 << (type))
+#define MAWIMCTL_EVENT_MASK_ALL ((1 << MAWIMCTL_EVENT_TYPE_INVALID) - 1)
+
+/* window is the X11 window id or 0, previous_workspace is only set for
+ * MAWIMCTL_EVENT_WORKSPACE_SWITCHED and MAWIMCTL_EVENT_WINDOW_MOVED.
+ */
+typedef struct mawimctl_event {
+  uint8_t                type;
+  mawimctl_workspaceid_t workspace;
+  mawimctl_workspaceid_t previous_workspace;
+  uint8_t                reserved;
+  uint32_t               window;
+} mawimctl_event_t;
+
+/* The MAWIMCTL_GET_STATE response is a header, followed by workspace_count
+ * workspaces and window_count windows, ordered by workspace.
+ */
+#define MAWIMCTL_STATE_TRUNCATED 0b00000001
+
+typedef struct mawimctl_state_header {
+  mawimctl_workspaceid_t active_workspace;
+  mawimctl_workspaceid_t workspace_count;
+  uint16_t               window_count;
+  uint8_t                flags;
+  uint8_t                reserved[3];
+} mawimctl_state_header_t;
+
+typedef struct mawimctl_state_workspace {
+  mawimctl_workspaceid_t id;
+  uint8_t                reserved;
+  uint16_t               row_count;
+  uint16_t               active_row;
+  uint16_t               window_count;
+  uint32_t               focused_window;
+} mawimctl_state_workspace_t;
+
+#define MAWIMCTL_STATE_WINDOW_MAPPED  0b00000001
+#define MAWIMCTL_STATE_WINDOW_FOCUSED 0b00000010
+
+typedef struct mawimctl_state_window {
+  uint32_t               window;
+  mawimctl_workspaceid_t workspace;
+  uint8_t                flags;
+  int16_t                row;
+  int16_t                col;
+  int16_t                x;
+  int16_t                y;
+  uint16_t               width;
+  uint16_t               height;
+  uint16_t               reserved;
+} mawimctl_state_window_t;
+
+/* The state page is a POSIX shared memory object MaWiM publishes its live
+ * state in. sequence is odd while MaWiM is writing, readers retry until they
+ * read the same even sequence before and after copying the page.
+ */
+#define MAWIMCTL_STATE_PAGE_MAGIC 0x4d41574d
+#define MAWIMCTL_STATE_PAGE_VERSION 1
+#define MAWIMCTL_STATE_PAGE_MAX_WORKSPACES 255
+
+typedef struct mawimctl_state_page_workspace {
+  uint16_t window_count;
+  uint16_t reserved;
+  uint32_t focused_window;
+} mawimctl_state_page_workspace_t;
+
+typedef struct mawimctl_state_page {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t sequence;
+  uint32_t reserved;
+
+  /* Incremented whenever anything below or the layout changed */
+  uint64_t generation;
+
+  mawimctl_workspaceid_t active_workspace;
+  mawimctl_workspaceid_t workspace_count;
+  uint8_t                reserved2[6];
+
+  mawimctl_state_page_workspace_t
+      workspaces[MAWIMCTL_STATE_PAGE_MAX_WORKSPACES];
+} mawimctl_state_page_t;
+
+#define MAWIMCTL_METRICS_FORMAT_BINARY 0
+#define MAWIMCTL_METRICS_FORMAT_PROMETHEUS 1
+
+#define MAWIMCTL_METRICS_EVENT_TYPES 36
+#define MAWIMCTL_METRICS_COMMANDS 32
+#define MAWIMCTL_METRICS_HISTOGRAM_BUCKETS 16
+
+/* Histogram bucket 0 counts zeroes, bucket n counts values in
+ * [2^(n-1), 2^n). The last bucket also counts everything above.
+ */
+typedef struct mawimctl_metrics {
+  uint64_t events_handled[MAWIMCTL_METRICS_EVENT_TYPES];
+  uint64_t events_unhandled;
+  uint64_t event_latency_us[MAWIMCTL_METRICS_HISTOGRAM_BUCKETS];
+  uint64_t event_latency_us_sum;
+
+  uint64_t x_requests;
+  uint64_t x_round_trips;
+
+  uint64_t layout_passes;
+  uint64_t windows_reconfigured;
+  uint64_t windows_reconfigured_per_pass[MAWIMCTL_METRICS_HISTOGRAM_BUCKETS];
+
+  uint64_t commands_handled[MAWIMCTL_METRICS_COMMANDS];
+  uint64_t command_latency_us[MAWIMCTL_METRICS_HISTOGRAM_BUCKETS];
+  uint64_t command_latency_us_sum;
+  uint64_t command_queue_depth;
+  uint64_t command_queue_depth_max;
+} mawimctl_metrics_t;
+
 /* clang-format on */
 
 #endif /* #ifndef MAWIMCTL_H */
@@ -5,12 +5,19 @@
  * information.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "mawimctl.h"
+#include "mawimctl_async.h"
 #include "mawimctl_client.h"
 
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 void panic(char *msg) {
   fprintf(stderr, "mawimctl panic'd: %s\n", msg);
@@ -24,7 +31,19 @@ const char *ERRNAMES[] = {"Ok",
                           "Configuration file is missing",
                           "Configuration file is malformed",
                           "No window currently focused",
-                          "MaWiM encountered an internal error"};
+                          "MaWiM encountered an internal error",
+                          "Tracing is disabled, start MaWiM with --trace",
+                          "Event"};
+
+const char *CMDNAMES[] = {"get_version",   "get_workspace",
+                          "set_workspace", "reload",
+                          "close_focused", "move_focused_to_workspace",
+                          "get_trace",     "metrics",
+                          "subscribe",     "get_state"};
+
+const char *EVENTNAMES[] = {"workspace_switched", "window_managed",
+                            "window_unmanaged", "focus_changed",
+                            "window_moved"};
 
 #define MAWIMCTL_CLIENT_BASEVERSION "1.0.1"
 
@@ -100,6 +119,146 @@ int get_version(mawimctl_connection_t *connection, int argc, char **argv) {
   return 0;
 }
 
+void print_histogram(char *name, uint64_t *histogram) {
+  for (int bucket = 0; bucket < MAWIMCTL_METRICS_HISTOGRAM_BUCKETS; bucket++) {
+    if (histogram[bucket] == 0) {
+      continue;
+    }
+
+    fprintf(stdout, "%s{<%lu} %lu\n", name, 1ul << bucket, histogram[bucket]);
+  }
+}
+
+int get_metrics(mawimctl_connection_t *connection, int argc, char **argv) {
+  bool prometheus = argc > 0 && strcmp(argv[0], "prometheus") == 0;
+  uint8_t format = prometheus ? MAWIMCTL_METRICS_FORMAT_PROMETHEUS
+                              : MAWIMCTL_METRICS_FORMAT_BINARY;
+
+  mawimctl_command_t cmd = {.command_identifier = MAWIMCTL_GET_METRICS,
+                            .flags = 0,
+                            .data_length = sizeof(format),
+                            .data = &format};
+  mawimctl_response_t resp;
+  do_cmd(connection, cmd, resp);
+
+  if (resp.data == NULL) {
+    panic("response data is NULL!");
+  }
+
+  if (prometheus) {
+    fprintf(stdout, "%s", (char *)resp.data);
+    return 0;
+  }
+
+  mawimctl_metrics_t metrics;
+  if (resp.data_length != sizeof(metrics)) {
+    panic("metrics have an unexpected size!");
+  }
+  memcpy(&metrics, resp.data, sizeof(metrics));
+
+  for (int type = 0; type < MAWIMCTL_METRICS_EVENT_TYPES; type++) {
+    if (metrics.events_handled[type] != 0) {
+      fprintf(stdout, "events_handled{type=%d} %lu\n", type,
+              metrics.events_handled[type]);
+    }
+  }
+  fprintf(stdout, "events_unhandled %lu\n", metrics.events_unhandled);
+  print_histogram("event_latency_us", metrics.event_latency_us);
+
+  fprintf(stdout, "x_requests %lu\n", metrics.x_requests);
+  fprintf(stdout, "x_round_trips %lu\n", metrics.x_round_trips);
+  fprintf(stdout, "layout_passes %lu\n", metrics.layout_passes);
+  fprintf(stdout, "windows_reconfigured %lu\n", metrics.windows_reconfigured);
+  print_histogram("windows_reconfigured_per_pass",
+                  metrics.windows_reconfigured_per_pass);
+
+  for (int id = 0; id < MAWIMCTL_CMD_INVALID; id++) {
+    fprintf(stdout, "commands_handled{command=%s} %lu\n", CMDNAMES[id],
+            metrics.commands_handled[id]);
+  }
+  print_histogram("command_latency_us", metrics.command_latency_us);
+  fprintf(stdout, "command_queue_depth %lu\n", metrics.command_queue_depth);
+  fprintf(stdout, "command_queue_depth_max %lu\n",
+          metrics.command_queue_depth_max);
+
+  return 0;
+}
+
+int get_state(mawimctl_connection_t *connection, int argc, char **argv) {
+  mawimctl_command_t cmd = {.command_identifier = MAWIMCTL_GET_STATE,
+                            .flags = 0,
+                            .data_length = 0,
+                            .data = NULL};
+  mawimctl_response_t resp;
+  do_cmd(connection, cmd, resp);
+
+  mawimctl_state_header_t header;
+  if (resp.data == NULL || resp.data_length < sizeof(header)) {
+    panic("state response is too short!");
+  }
+  memcpy(&header, resp.data, sizeof(header));
+
+  size_t ws_offs = sizeof(header);
+  size_t win_offs =
+      ws_offs + header.workspace_count * sizeof(mawimctl_state_workspace_t);
+  if (resp.data_length < win_offs + header.window_count *
+                                        sizeof(mawimctl_state_window_t)) {
+    panic("state response is too short!");
+  }
+
+  fprintf(stdout, "{\"active_workspace\":%d,\"truncated\":%s,\"workspaces\":[",
+          header.active_workspace,
+          header.flags & MAWIMCTL_STATE_TRUNCATED ? "true" : "false");
+
+  for (int wix = 0; wix < header.workspace_count; wix++) {
+    mawimctl_state_workspace_t ws;
+    memcpy(&ws, resp.data + ws_offs + wix * sizeof(ws), sizeof(ws));
+
+    fprintf(stdout,
+            "%s{\"id\":%d,\"row_count\":%d,\"active_row\":%d,"
+            "\"focused_window\":%u,\"windows\":[",
+            wix > 0 ? "," : "", ws.id, ws.row_count, ws.active_row,
+            ws.focused_window);
+
+    for (int cix = 0; cix < ws.window_count; cix++) {
+      mawimctl_state_window_t win;
+      memcpy(&win, resp.data + win_offs, sizeof(win));
+      win_offs += sizeof(win);
+
+      fprintf(stdout,
+              "%s{\"window\":%u,\"row\":%d,\"col\":%d,\"x\":%d,\"y\":%d,"
+              "\"width\":%d,\"height\":%d,\"mapped\":%s,\"focused\":%s}",
+              cix > 0 ? "," : "", win.window, win.row, win.col, win.x, win.y,
+              win.width, win.height,
+              win.flags & MAWIMCTL_STATE_WINDOW_MAPPED ? "true" : "false",
+              win.flags & MAWIMCTL_STATE_WINDOW_FOCUSED ? "true" : "false");
+    }
+
+    fprintf(stdout, "]}");
+  }
+
+  fprintf(stdout, "]}\n");
+
+  return 0;
+}
+
+int get_trace(mawimctl_connection_t *connection, int argc, char **argv) {
+  mawimctl_command_t cmd = {.command_identifier = MAWIMCTL_GET_TRACE,
+                            .flags = 0,
+                            .data_length = 0,
+                            .data = NULL};
+  mawimctl_response_t resp;
+  do_cmd(connection, cmd, resp);
+
+  if (resp.data == NULL) {
+    panic("response data is NULL!");
+  }
+
+  fprintf(stdout, "%s\n", (char *)resp.data);
+
+  return 0;
+}
+
 int get_workspace(mawimctl_connection_t *connection, int argc, char **argv) {
   mawimctl_command_t cmd = {.command_identifier = MAWIMCTL_GET_WORKSPACE,
                             .flags = 0,
@@ -149,6 +308,52 @@ int do_move_focused_to_workspace(mawimctl_connection_t *connection, int argc,
   return 0;
 }
 
+int do_subscribe(mawimctl_connection_t *connection, int argc, char **argv) {
+  uint8_t mask = argc == 0 ? MAWIMCTL_EVENT_MASK_ALL : 0;
+
+  for (int i = 0; i < argc; i++) {
+    int type = 0;
+    while (type < MAWIMCTL_EVENT_TYPE_INVALID &&
+           strcmp(argv[i], EVENTNAMES[type]) != 0) {
+      type++;
+    }
+
+    if (type == MAWIMCTL_EVENT_TYPE_INVALID) {
+      fprintf(stderr, "no such event type: %s\n", argv[i]);
+      return 1;
+    }
+
+    mask |= MAWIMCTL_EVENT_MASK(type);
+  }
+
+  mawimctl_command_t cmd = {.command_identifier = MAWIMCTL_SUBSCRIBE,
+                            .flags = 0,
+                            .data_length = sizeof(mask),
+                            .data = &mask};
+  mawimctl_response_t resp;
+  do_cmd(connection, cmd, resp);
+
+  /* Print events until MaWiM goes away */
+  while (mawimctl_read_response(connection, &resp)) {
+    mawimctl_event_t event;
+    if (resp.status != MAWIMCTL_EVENT || resp.data_length != sizeof(event)) {
+      break;
+    }
+    memcpy(&event, resp.data, sizeof(event));
+
+    if (event.type >= MAWIMCTL_EVENT_TYPE_INVALID) {
+      continue;
+    }
+
+    fprintf(stdout, "%s workspace=%d previous=%d window=0x%08x\n",
+            EVENTNAMES[event.type], event.workspace, event.previous_workspace,
+            event.window);
+    fflush(stdout);
+  }
+
+  return 0;
+}
+
 int do_reload(mawimctl_connection_t *connection, int argc, char **argv) {
   return do_generic_cmd(connection, MAWIMCTL_RELOAD);
 }
@@ -191,8 +396,13 @@ const struct handler cmd_handlers[] = {
     {.cmd_name = "close_focused",
      .params_str = "",
      .handler = &do_close_focused},
+    {.cmd_name = "get_state", .params_str = "", .handler = &get_state},
+    {.cmd_name = "get_trace", .params_str = "", .handler = &get_trace},
     {.cmd_name = "get_version", .params_str = "", .handler = &get_version},
     {.cmd_name = "get_workspace", .params_str = "", .handler = &get_workspace},
+    {.cmd_name = "metrics",
+     .params_str = "[prometheus]",
+     .handler = &get_metrics},
     {.cmd_name = "move_focused_to_workspace",
      .params_str = "<workspace number>",
      .handler = &do_move_focused_to_workspace},
@@ -200,14 +410,317 @@ const struct handler cmd_handlers[] = {
     {.cmd_name = "set_workspace",
      .params_str = "<workspace number>",
      .handler = &set_workspace},
+    {.cmd_name = "subscribe",
+     .params_str = "[event type...]",
+     .handler = &do_subscribe},
 };
 
 const int cmd_handlers_count = sizeof(cmd_handlers) / sizeof(struct handler);
 
+/* batch mode */
+
+/* Maximum amount of batched commands awaiting a response */
+#define BATCH_MAX_PENDING 64
+
+/* Maximum length of a single line read in batch mode */
+#define BATCH_LINE_MAXSIZE 4096
+
+struct batch_slot {
+  unsigned long line;
+  const char *cmd_name;
+};
+
+struct batch {
+  /* Has to stay the first member, see batch_on_response() */
+  mawimctl_async_t connection;
+  uint8_t recv_buffer[MAWIMCTL_RESPONSE_MAXSIZE];
+  mawimctl_async_request_t pending[BATCH_MAX_PENDING];
+
+  /* Used in the same order as the pending requests of the connection */
+  struct batch_slot slots[BATCH_MAX_PENDING];
+  unsigned long slots_used;
+
+  unsigned long line;
+  unsigned long commands;
+  unsigned long failed;
+};
+
+void batch_on_response(mawimctl_async_t *connection,
+                       const mawimctl_response_t *resp, void *userdata) {
+  struct batch *batch = (struct batch *)connection;
+  struct batch_slot *slot = userdata;
+
+  fprintf(stdout, "%lu %s: ", slot->line, slot->cmd_name);
+
+  if (resp->status != MAWIMCTL_OK) {
+    batch->failed++;
+    fprintf(stdout, "%s\n",
+            resp->status < MAWIMCTL_STATUS_INVALID ? ERRNAMES[resp->status]
+                                                   : "unknown error");
+    return;
+  }
+
+  if (resp->data_length > 0 && strcmp(slot->cmd_name, "get_version") == 0) {
+    fprintf(stdout, "Ok %.*s\n",
+            (int)strnlen((char *)resp->data, resp->data_length),
+            (char *)resp->data);
+  } else if (resp->data_length > 0 &&
+             strcmp(slot->cmd_name, "get_workspace") == 0) {
+    fprintf(stdout, "Ok %d\n", (mawimctl_workspaceid_t)*resp->data);
+  } else {
+    fprintf(stdout, "Ok\n");
+  }
+}
+
+/**
+ * @brief Builds the command for one batch line. Only commands with no or a
+ * short response can be batched.
+ * @return false if the line is not a valid batch command
+ */
+bool batch_parse_command(int argc, char **argv, mawimctl_command_t *cmd,
+                         mawimctl_workspaceid_t *workspace) {
+  cmd->command_identifier = MAWIMCTL_CMD_INVALID;
+  cmd->data_length = 0;
+  cmd->data = NULL;
+
+  const uint8_t batchable[] = {
+      MAWIMCTL_GET_VERSION,   MAWIMCTL_GET_WORKSPACE,
+      MAWIMCTL_SET_WORKSPACE, MAWIMCTL_RELOAD,
+      MAWIMCTL_CLOSE_FOCUSED, MAWIMCTL_MOVE_FOCUSED_TO_WORKSPACE,
+  };
+
+  for (size_t i = 0; i < sizeof(batchable); i++) {
+    if (strcmp(argv[0], CMDNAMES[batchable[i]]) == 0) {
+      cmd->command_identifier = batchable[i];
+      break;
+    }
+  }
+
+  switch (cmd->command_identifier) {
+  case MAWIMCTL_CMD_INVALID:
+    return false;
+  case MAWIMCTL_SET_WORKSPACE:
+  case MAWIMCTL_MOVE_FOCUSED_TO_WORKSPACE:
+    if (argc < 2) {
+      return false;
+    }
+
+    *workspace = atoi(argv[1]);
+    if (*workspace < 1 || *workspace > 9) {
+      return false;
+    }
+
+    cmd->data_length = sizeof(*workspace);
+    cmd->data = workspace;
+    break;
+  default:
+    break;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Waits until the connection is readable or, if want_write is set,
+ * writable and handles all responses which arrived.
+ * @return false if the connection failed
+ */
+bool batch_wait(struct batch *batch, bool want_write) {
+  struct pollfd pfd = {.fd = mawimctl_async_fd(&batch->connection),
+                       .events = POLLIN | (want_write ? POLLOUT : 0)};
+
+  while (poll(&pfd, 1, -1) == -1) {
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+
+  return mawimctl_async_dispatch(&batch->connection) == MAWIMCTL_ASYNC_OK;
+}
+
+/**
+ * @brief Sends the command of a single line. Lines starting with '!' are sent
+ * with MAWIMCTL_FLAG_NO_RESPONSE, empty lines and lines starting with '#' are
+ * skipped.
+ * @return false if the connection failed
+ */
+bool batch_handle_line(struct batch *batch, char *line) {
+  batch->line++;
+
+  bool no_response = line[0] == '!';
+  if (no_response) {
+    line++;
+  }
+
+  char *argv[3];
+  int argc = 0;
+  char *saveptr = NULL;
+  for (char *tok = strtok_r(line, " \t\r", &saveptr); tok != NULL && argc < 3;
+       tok = strtok_r(NULL, " \t\r", &saveptr)) {
+    argv[argc++] = tok;
+  }
+
+  if (argc == 0 || argv[0][0] == '#') {
+    return true;
+  }
+
+  batch->commands++;
+
+  mawimctl_command_t cmd;
+  mawimctl_workspaceid_t workspace;
+  if (!batch_parse_command(argc, argv, &cmd, &workspace)) {
+    batch->failed++;
+    fprintf(stdout, "%lu %s: not a valid batch command\n", batch->line,
+            argv[0]);
+    return true;
+  }
+
+  cmd.flags = no_response ? MAWIMCTL_FLAG_NO_RESPONSE : 0;
+  const char *cmd_name = CMDNAMES[cmd.command_identifier];
+
+  /* Slots are reused in the order responses arrive, the next one is only
+   * free once fewer than BATCH_MAX_PENDING requests are in flight
+   */
+  struct batch_slot *slot = NULL;
+  if (!no_response) {
+    while (batch->connection.pending_count == BATCH_MAX_PENDING) {
+      if (!batch_wait(batch, false)) {
+        return false;
+      }
+    }
+
+    slot = &batch->slots[batch->slots_used % BATCH_MAX_PENDING];
+    slot->line = batch->line;
+    slot->cmd_name = cmd_name;
+  }
+
+  while (true) {
+    int res = mawimctl_async_send(&batch->connection, &cmd,
+                                  no_response ? NULL : &batch_on_response,
+                                  slot);
+    if (res == MAWIMCTL_ASYNC_OK) {
+      break;
+    }
+
+    if (res == MAWIMCTL_ASYNC_ERROR ||
+        !batch_wait(batch, res == MAWIMCTL_ASYNC_AGAIN)) {
+      return false;
+    }
+  }
+
+  if (no_response) {
+    fprintf(stdout, "%lu %s: Sent\n", batch->line, cmd_name);
+  } else {
+    batch->slots_used++;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Reads newline separated commands from stdin and sends them over a
+ * single connection without waiting for each response.
+ */
+int do_batch() {
+  static struct batch batch;
+  static char line_buffer[BATCH_LINE_MAXSIZE];
+  size_t line_used = 0;
+
+  struct timespec begin;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+
+  if (mawimctl_async_connect(&batch.connection, getenv("MAWIMCTL_SOCK"),
+                             batch.recv_buffer, sizeof(batch.recv_buffer),
+                             batch.pending,
+                             BATCH_MAX_PENDING) != MAWIMCTL_ASYNC_OK) {
+    macro_connection_null_panic();
+  }
+
+  struct pollfd fds[2] = {
+      {.fd = STDIN_FILENO, .events = POLLIN},
+      {.fd = mawimctl_async_fd(&batch.connection), .events = POLLIN},
+  };
+
+  bool input_done = false;
+  bool connection_ok = true;
+  while (connection_ok &&
+         (!input_done || batch.connection.pending_count > 0)) {
+    struct pollfd *poll_fds = input_done ? &fds[1] : &fds[0];
+    if (poll(poll_fds, input_done ? 1 : 2, -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    if (fds[1].revents != 0) {
+      connection_ok =
+          mawimctl_async_dispatch(&batch.connection) == MAWIMCTL_ASYNC_OK;
+    }
+
+    if (!input_done && fds[0].revents != 0) {
+      ssize_t bytes_read = read(STDIN_FILENO, line_buffer + line_used,
+                                sizeof(line_buffer) - line_used - 1);
+      if (bytes_read <= 0) {
+        input_done = true;
+        fds[0].revents = 0;
+
+        /* The last line may not be terminated */
+        if (line_used > 0) {
+          line_buffer[line_used] = 0;
+          connection_ok = batch_handle_line(&batch, line_buffer);
+        }
+      } else {
+        line_used += bytes_read;
+      }
+
+      char *line = line_buffer;
+      char *newline;
+      while (connection_ok && !input_done &&
+             (newline = memchr(line, '\n', line_used - (line - line_buffer)))) {
+        *newline = 0;
+        connection_ok = batch_handle_line(&batch, line);
+        line = newline + 1;
+      }
+
+      /* Overlong lines are handled in pieces */
+      if (line == line_buffer && line_used == sizeof(line_buffer) - 1) {
+        line_buffer[line_used] = 0;
+        connection_ok = batch_handle_line(&batch, line_buffer);
+        line = line_buffer + line_used;
+      }
+
+      line_used -= line - line_buffer;
+      memmove(line_buffer, line, line_used);
+    }
+
+    fflush(stdout);
+  }
+
+  mawimctl_async_disconnect(&batch.connection);
+
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double elapsed_ms = (end.tv_sec - begin.tv_sec) * 1e3 +
+                      (end.tv_nsec - begin.tv_nsec) / 1e6;
+
+  fprintf(stderr, "%lu commands, %lu failed in %.3fms\n", batch.commands,
+          batch.failed, elapsed_ms);
+
+  if (!connection_ok || batch.connection.pending_count > 0) {
+    fprintf(stderr, "connection to MaWiM lost, %zu commands unanswered!\n",
+            batch.connection.pending_count);
+    return 2;
+  }
+
+  return batch.failed > 0 ? 3 : 0;
+}
+
 void list_commands() {
   fprintf(stderr, "=> client version " MAWIMCTL_CLIENT_VERSION
                   "\n=> protocol version " MAWIMCTL_VERSION "\n\n");
   fprintf(stderr, "Usage: mawimctl <command [parameters]>\n");
+  fprintf(stderr, "       mawimctl - | --batch\n");
   fprintf(stderr, "Commands:\n");
   for (int i = 0; i < cmd_handlers_count; i++) {
     fprintf(stderr, "\t%s %s\n", cmd_handlers[i].cmd_name,
@@ -221,6 +734,10 @@ int main(int argc, char **argv) {
     return 0;
   }
 
+  if (strcmp(argv[1], "-") == 0 || strcmp(argv[1], "--batch") == 0) {
+    return do_batch();
+  }
+
   int ret = -1;
 
   for (int i = 0; i < cmd_handlers_count; i++) {
@@ -232,7 +749,7 @@ int main(int argc, char **argv) {
       }
 
       ret = cmd_handlers[i].handler(connection, argc - 2, &argv[2]);
-      free(connection);
+      mawimctl_client_disconnect(connection);
       break;
     }
   }
@@ -0,0 +1,156 @@
+/* mawimctl_async.c ; implementation for non-blocking mawimctl clients.
+ * See github.com/FelixEcker/mawim.git -> doc/mawimctl.md
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#include "mawimctl_async.h"
+
+#include "mawimctl_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int mawimctl_async_connect(mawimctl_async_t *connection, const char *where,
+                           uint8_t *recv_buffer, size_t recv_buffer_size,
+                           mawimctl_async_request_t *pending,
+                           size_t pending_capacity) {
+  if (where == NULL) {
+    where = MAWIMCTL_DEFAULT_SOCK_LOCATION;
+  }
+
+  connection->recv_buffer = recv_buffer;
+  connection->recv_buffer_size = recv_buffer_size;
+  connection->pending = pending;
+  connection->pending_capacity = pending_capacity;
+  connection->pending_head = 0;
+  connection->pending_count = 0;
+  connection->on_event = NULL;
+  connection->event_userdata = NULL;
+
+  connection->sock_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (connection->sock_fd == -1) {
+    return MAWIMCTL_ASYNC_ERROR;
+  }
+
+  struct sockaddr_un sock_name;
+  memset(&sock_name, 0, sizeof(sock_name));
+  sock_name.sun_family = AF_UNIX;
+  strncpy(sock_name.sun_path, where, sizeof(sock_name.sun_path) - 1);
+
+  /* Connecting to a local socket does not wait on the server */
+  if (connect(connection->sock_fd, (const struct sockaddr *)&sock_name,
+              sizeof(sock_name)) == -1) {
+    int err = errno;
+    close(connection->sock_fd);
+    connection->sock_fd = -1;
+    errno = err;
+    return MAWIMCTL_ASYNC_ERROR;
+  }
+
+  fcntl(connection->sock_fd, F_SETFL, O_NONBLOCK);
+
+  return MAWIMCTL_ASYNC_OK;
+}
+
+int mawimctl_async_fd(const mawimctl_async_t *connection) {
+  return connection->sock_fd;
+}
+
+void mawimctl_async_on_event(mawimctl_async_t *connection,
+                             mawimctl_async_callback_t callback,
+                             void *userdata) {
+  connection->on_event = callback;
+  connection->event_userdata = userdata;
+}
+
+int mawimctl_async_send(mawimctl_async_t *connection,
+                        const mawimctl_command_t *command,
+                        mawimctl_async_callback_t callback, void *userdata) {
+  bool wants_response = !(command->flags & MAWIMCTL_FLAG_NO_RESPONSE);
+  if (wants_response &&
+      connection->pending_count == connection->pending_capacity) {
+    return MAWIMCTL_ASYNC_FULL;
+  }
+
+  if (_mawimctl_send_command(connection->sock_fd, command) == -1) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return MAWIMCTL_ASYNC_AGAIN;
+    }
+
+    return MAWIMCTL_ASYNC_ERROR;
+  }
+
+  if (wants_response) {
+    size_t ix = (connection->pending_head + connection->pending_count) %
+                connection->pending_capacity;
+    connection->pending[ix].callback = callback;
+    connection->pending[ix].userdata = userdata;
+    connection->pending_count++;
+  }
+
+  return MAWIMCTL_ASYNC_OK;
+}
+
+int mawimctl_async_dispatch(mawimctl_async_t *connection) {
+  while (true) {
+    mawimctl_response_t response;
+    int bytes_read =
+        _mawimctl_recv_response(connection->sock_fd, connection->recv_buffer,
+                                connection->recv_buffer_size, &response);
+
+    if (bytes_read == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return MAWIMCTL_ASYNC_OK;
+      }
+
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return MAWIMCTL_ASYNC_ERROR;
+    }
+
+    if (bytes_read == 0) {
+      return MAWIMCTL_ASYNC_CLOSED;
+    }
+
+    if (response.status == MAWIMCTL_EVENT) {
+      if (connection->on_event != NULL) {
+        connection->on_event(connection, &response,
+                             connection->event_userdata);
+      }
+      continue;
+    }
+
+    /* Responses arrive in the order the commands were sent */
+    if (connection->pending_count == 0) {
+      continue;
+    }
+
+    mawimctl_async_request_t request =
+        connection->pending[connection->pending_head];
+    connection->pending_head =
+        (connection->pending_head + 1) % connection->pending_capacity;
+    connection->pending_count--;
+
+    if (request.callback != NULL) {
+      request.callback(connection, &response, request.userdata);
+    }
+  }
+}
+
+void mawimctl_async_disconnect(mawimctl_async_t *connection) {
+  if (connection->sock_fd >= 0) {
+    close(connection->sock_fd);
+  }
+
+  connection->sock_fd = -1;
+  connection->pending_count = 0;
+}
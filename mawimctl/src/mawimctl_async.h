@@ -0,0 +1,136 @@
+/* mawimctl_async.h ; header for non-blocking mawimctl clients.
+ * See github.com/FelixEcker/mawim.git -> doc/mawimctl.md
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#ifndef MAWIMCTL_ASYNC_H
+#define MAWIMCTL_ASYNC_H
+
+#include "mawimctl.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct mawimctl_async mawimctl_async_t;
+
+/**
+ * @brief Called for every response and pushed event. The response data
+ * points into the receive buffer of the connection and is only valid during
+ * the call.
+ */
+typedef void (*mawimctl_async_callback_t)(mawimctl_async_t *connection,
+                                          const mawimctl_response_t *response,
+                                          void *userdata);
+
+enum mawimctl_async_result {
+  MAWIMCTL_ASYNC_OK = 0,
+  /* The socket can not take the command right now, wait for it to become
+   * writable and send it again.
+   */
+  MAWIMCTL_ASYNC_AGAIN,
+  /* Too many requests are awaiting a response */
+  MAWIMCTL_ASYNC_FULL,
+  MAWIMCTL_ASYNC_CLOSED,
+  MAWIMCTL_ASYNC_ERROR,
+};
+
+/* clang-format off */
+
+typedef struct mawimctl_async_request {
+  mawimctl_async_callback_t  callback;
+  void                      *userdata;
+} mawimctl_async_request_t;
+
+struct mawimctl_async {
+  int                        sock_fd;
+
+  /* Caller provided */
+  uint8_t                   *recv_buffer;
+  size_t                     recv_buffer_size;
+
+  /* Requests awaiting a response, oldest first, caller provided */
+  mawimctl_async_request_t  *pending;
+  size_t                     pending_capacity;
+  size_t                     pending_head;
+  size_t                     pending_count;
+
+  /* Called for messages with status MAWIMCTL_EVENT */
+  mawimctl_async_callback_t  on_event;
+  void                      *event_userdata;
+};
+
+/* clang-format on */
+
+/**
+ * @brief Connects to the mawimctl server without blocking afterwards. Nothing
+ * is allocated, all storage is provided by the caller.
+ * @param connection The connection to be initialised
+ * @param where The location of the socket, if NULL it will default to
+ * MAWIMCTL_DEFAULT_SOCK_LOCATION
+ * @param recv_buffer Where responses are received to. Data of responses larger
+ * than MAWIMCTL_RESPONSE_MAXSIZE - MAWIMCTL_RESPONSE_BASESIZE is cut off.
+ * @param recv_buffer_size The size of recv_buffer
+ * @param pending Storage for the requests awaiting a response
+ * @param pending_capacity The amount of entries in pending, this is how many
+ * requests can be in flight at once
+ * @return MAWIMCTL_ASYNC_OK on success, MAWIMCTL_ASYNC_ERROR with errno set
+ * otherwise
+ */
+int mawimctl_async_connect(mawimctl_async_t *connection, const char *where,
+                           uint8_t *recv_buffer, size_t recv_buffer_size,
+                           mawimctl_async_request_t *pending,
+                           size_t pending_capacity);
+
+/**
+ * @brief Gets the file descriptor to watch for readability in an event loop
+ * @param connection The connection
+ * @return The socket file descriptor
+ */
+int mawimctl_async_fd(const mawimctl_async_t *connection);
+
+/**
+ * @brief Sets the callback for events pushed after MAWIMCTL_SUBSCRIBE
+ * @param connection The connection
+ * @param callback The callback, NULL to ignore events
+ * @param userdata Passed to the callback
+ */
+void mawimctl_async_on_event(mawimctl_async_t *connection,
+                             mawimctl_async_callback_t callback,
+                             void *userdata);
+
+/**
+ * @brief Sends a command without waiting for its response. Any amount of
+ * commands up to the pending capacity can be in flight.
+ * @param connection The connection
+ * @param command The command, the data is sent from where it is and can be
+ * reused once this returns
+ * @param callback Called with the response, may be NULL. Not used if the
+ * command has MAWIMCTL_FLAG_NO_RESPONSE set.
+ * @param userdata Passed to the callback
+ * @return MAWIMCTL_ASYNC_OK, MAWIMCTL_ASYNC_AGAIN, MAWIMCTL_ASYNC_FULL or
+ * MAWIMCTL_ASYNC_ERROR
+ */
+int mawimctl_async_send(mawimctl_async_t *connection,
+                        const mawimctl_command_t *command,
+                        mawimctl_async_callback_t callback, void *userdata);
+
+/**
+ * @brief Reads all responses and events available without blocking and calls
+ * their callbacks. Call whenever the fd is readable.
+ * @param connection The connection
+ * @return MAWIMCTL_ASYNC_OK, MAWIMCTL_ASYNC_CLOSED if the server went away or
+ * MAWIMCTL_ASYNC_ERROR
+ */
+int mawimctl_async_dispatch(mawimctl_async_t *connection);
+
+/**
+ * @brief Closes the connection. Callbacks of requests still in flight are not
+ * called.
+ * @param connection The connection
+ */
+void mawimctl_async_disconnect(mawimctl_async_t *connection);
+
+#endif /* #ifndef MAWIMCTL_ASYNC_H */
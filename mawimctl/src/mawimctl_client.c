@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 mawimctl_connection_t *mawimctl_client_connect(char *where) {
@@ -31,6 +32,14 @@ mawimctl_connection_t *mawimctl_client_connect(char *where) {
 
   connection->sock_path = where;
 
+  connection->recv_buffer =
+      malloc(MAWIMCTL_RESPONSE_MAXSIZE - MAWIMCTL_RESPONSE_BASESIZE);
+  if (connection->recv_buffer == NULL) {
+    fprintf(stderr, "Couldn't allocate memory for connection!\n");
+    free(connection);
+    return NULL;
+  }
+
   /* Initialise Socket */
   connection->sock_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
   if (connection->sock_fd == -1) {
@@ -39,6 +48,7 @@ mawimctl_connection_t *mawimctl_client_connect(char *where) {
             "mawimctl_connection: error creating connection: %s "
             "(OS Error %d)\n",
             errstr, errno);
+    free(connection->recv_buffer);
     free(connection);
     return NULL;
   }
@@ -58,6 +68,8 @@ mawimctl_connection_t *mawimctl_client_connect(char *where) {
             "mawimctl_connection: error connecting: %s "
             "(OS Error %d)\n",
             errstr, errno);
+    close(connection->sock_fd);
+    free(connection->recv_buffer);
     free(connection);
     return NULL;
   }
@@ -65,61 +77,78 @@ mawimctl_connection_t *mawimctl_client_connect(char *where) {
   return connection;
 }
 
-bool mawimctl_client_send_command(mawimctl_connection_t *connection,
-                                  mawimctl_command_t command) {
-  size_t sendbuf_size = MAWIMCTL_COMMAND_BASESIZE + command.data_length;
-  uint8_t *sendbuf = malloc(sendbuf_size);
-  memset(sendbuf, 0, sendbuf_size);
+int _mawimctl_send_command(int sock_fd, const mawimctl_command_t *command) {
+  uint16_t data_length = command->data != NULL ? command->data_length : 0;
 
-  /* Copy data to send buffer */
+  uint8_t header[MAWIMCTL_COMMAND_BASESIZE - 1];
   int cpyoffs = 0;
 
-  memcpy(sendbuf + cpyoffs, &command.command_identifier,
-         sizeof(command.command_identifier));
-  cpyoffs += sizeof(command.command_identifier);
-
-  memcpy(sendbuf + cpyoffs, &command.flags, sizeof(command.flags));
-  cpyoffs += sizeof(command.flags);
+  memcpy(header + cpyoffs, &command->command_identifier,
+         sizeof(command->command_identifier));
+  cpyoffs += sizeof(command->command_identifier);
 
-  if (command.data != NULL) {
-    memcpy(sendbuf + cpyoffs, &command.data_length,
-           sizeof(command.data_length));
-    cpyoffs += sizeof(command.data_length);
+  memcpy(header + cpyoffs, &command->flags, sizeof(command->flags));
+  cpyoffs += sizeof(command->flags);
 
-    memcpy(sendbuf + cpyoffs, command.data, command.data_length);
-  }
+  memcpy(header + cpyoffs, &data_length, sizeof(data_length));
 
-  bool success = write(connection->sock_fd, sendbuf, sendbuf_size) != -1;
+  /* The data is sent from where the caller has it, followed by the padding
+   * byte of the wire format.
+   */
+  uint8_t padding = 0;
+  struct iovec iov[3] = {
+      {.iov_base = header, .iov_len = sizeof(header)},
+      {.iov_base = command->data, .iov_len = data_length},
+      {.iov_base = &padding, .iov_len = sizeof(padding)},
+  };
+  struct msghdr msg = {.msg_iov = iov, .msg_iovlen = 3};
 
-  free(sendbuf);
-  return success;
+  return sendmsg(sock_fd, &msg, MSG_NOSIGNAL);
 }
 
-mawimctl_response_t _parse_response(uint8_t *buff, int buffsize) {
-  mawimctl_response_t ret = {
-      .status = MAWIMCTL_STATUS_INVALID, .data_length = 0, .data = NULL};
-
-  if (buffsize < MAWIMCTL_RESPONSE_BASESIZE) {
-    return ret;
+int _mawimctl_recv_response(int sock_fd, uint8_t *buffer, size_t size,
+                            mawimctl_response_t *dest) {
+  /* Receive the header and the data straight into place */
+  uint8_t header[MAWIMCTL_RESPONSE_BASESIZE];
+  struct iovec iov[2] = {
+      {.iov_base = header, .iov_len = sizeof(header)},
+      {.iov_base = buffer, .iov_len = size},
+  };
+  struct msghdr msg = {.msg_iov = iov, .msg_iovlen = 2};
+
+  int bytes_read = recvmsg(sock_fd, &msg, 0);
+  if (bytes_read == -1) {
+    return -1;
   }
 
-  int cpyoffs = 0;
-  memcpy(&ret.status, buff + cpyoffs, sizeof(ret.status));
-  cpyoffs += sizeof(ret.status);
+  dest->status = MAWIMCTL_STATUS_INVALID;
+  dest->data_length = 0;
+  dest->data = NULL;
 
-  memcpy(&ret.data_length, buff + cpyoffs, sizeof(ret.data_length));
-  cpyoffs += sizeof(ret.data_length);
+  if (bytes_read < MAWIMCTL_RESPONSE_BASESIZE) {
+    return bytes_read;
+  }
+
+  memcpy(&dest->status, header, sizeof(dest->status));
+  memcpy(&dest->data_length, header + sizeof(dest->status),
+         sizeof(dest->data_length));
 
-  int to_copy = ret.data_length > (buffsize - MAWIMCTL_RESPONSE_BASESIZE)
-                    ? (buffsize - MAWIMCTL_RESPONSE_BASESIZE)
-                    : ret.data_length;
+  /* Whatever did not fit into the buffer was discarded by the kernel */
+  int available = bytes_read - MAWIMCTL_RESPONSE_BASESIZE;
+  if (dest->data_length > available) {
+    dest->data_length = available;
+  }
 
-  if (to_copy > 0) {
-    ret.data = malloc(to_copy);
-    memcpy(ret.data, buff + cpyoffs, to_copy);
+  if (available > 0) {
+    dest->data = buffer;
   }
 
-  return ret;
+  return bytes_read;
+}
+
+bool mawimctl_client_send_command(mawimctl_connection_t *connection,
+                                  mawimctl_command_t command) {
+  return _mawimctl_send_command(connection->sock_fd, &command) != -1;
 }
 
 bool mawimctl_read_response(mawimctl_connection_t *connection,
@@ -128,8 +157,9 @@ bool mawimctl_read_response(mawimctl_connection_t *connection,
     return false;
   }
 
-  uint8_t recvbuf[MAWIMCTL_COMMAND_MAXSIZE];
-  int bytes_read = read(connection->sock_fd, recvbuf, sizeof(recvbuf));
+  int bytes_read = _mawimctl_recv_response(
+      connection->sock_fd, connection->recv_buffer,
+      MAWIMCTL_RESPONSE_MAXSIZE - MAWIMCTL_RESPONSE_BASESIZE, dest);
 
   if (bytes_read == -1) {
     fprintf(stderr, "failed to read response!\n");
@@ -137,7 +167,15 @@ bool mawimctl_read_response(mawimctl_connection_t *connection,
     return false;
   }
 
-  *dest = _parse_response(recvbuf, bytes_read);
-
   return true;
 }
+
+void mawimctl_client_disconnect(mawimctl_connection_t *connection) {
+  if (connection == NULL) {
+    return;
+  }
+
+  close(connection->sock_fd);
+  free(connection->recv_buffer);
+  free(connection);
+}
@@ -12,6 +12,7 @@
 #include "mawimctl.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <sys/un.h>
 
 /* clang-format off */
@@ -20,6 +21,9 @@ typedef struct mawimctl_connection {
   int                 sock_fd;
   char               *sock_path;
   struct sockaddr_un  sock_name;
+
+  /* Response data is received into this buffer */
+  uint8_t            *recv_buffer;
 } mawimctl_connection_t;
 
 /* clang-format on */
@@ -43,7 +47,8 @@ bool mawimctl_client_send_command(mawimctl_connection_t *connection,
                                   mawimctl_command_t command);
 
 /**
- * @brief Read a response from the mawimctl server into dest
+ * @brief Read a response from the mawimctl server into dest. The response data
+ * belongs to the connection and stays valid until the next response is read.
  * @param connection The connection the response should be read from
  * @param dest Pointer to a response structure where the response should be
  * written to
@@ -52,4 +57,34 @@ bool mawimctl_client_send_command(mawimctl_connection_t *connection,
 bool mawimctl_read_response(mawimctl_connection_t *connection,
                             mawimctl_response_t *dest);
 
+/* Framing shared by the blocking and the asynchronous client */
+
+/**
+ * @brief Sends a command in a single message
+ * @param sock_fd The socket to send on
+ * @param command The command, its data is sent from where it is
+ * @return The result of sendmsg()
+ */
+int _mawimctl_send_command(int sock_fd, const mawimctl_command_t *command);
+
+/**
+ * @brief Receives a single response or event message
+ * @param sock_fd The socket to receive from
+ * @param buffer Where the response data is received to, dest->data points into
+ * it. Data which does not fit is discarded.
+ * @param size The size of buffer
+ * @param dest Where the response should be written to, its status is
+ * MAWIMCTL_STATUS_INVALID if the message was too short
+ * @return The result of recvmsg()
+ */
+int _mawimctl_recv_response(int sock_fd, uint8_t *buffer, size_t size,
+                            mawimctl_response_t *dest);
+
+/**
+ * @brief Close a connection and free its structure. A connection can be used
+ * for any amount of commands before it is closed.
+ * @param connection The connection to be closed
+ */
+void mawimctl_client_disconnect(mawimctl_connection_t *connection);
+
 #endif /* #ifndef MAWIMCTL_CLIENT_H */
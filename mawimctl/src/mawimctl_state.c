@@ -0,0 +1,85 @@
+/* mawimctl_state.c ; implementation for reading the MaWiM state page.
+ * See github.com/FelixEcker/mawim.git -> doc/mawimctl.md
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "mawimctl_state.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* A writer holds the page for a few hundred nanoseconds at most */
+#define MAWIMCTL_STATE_READ_ATTEMPTS 1000
+
+const mawimctl_state_page_t *mawimctl_state_open(const char *name) {
+  if (name == NULL) {
+    name = MAWIMCTL_DEFAULT_STATE_PAGE_NAME;
+  }
+
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd == -1) {
+    fprintf(stderr, "mawimctl_state: could not open \"%s\": %s\n", name,
+            strerror(errno));
+    return NULL;
+  }
+
+  void *mapping =
+      mmap(NULL, sizeof(mawimctl_state_page_t), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (mapping == MAP_FAILED) {
+    fprintf(stderr, "mawimctl_state: could not map \"%s\": %s\n", name,
+            strerror(errno));
+    return NULL;
+  }
+
+  const mawimctl_state_page_t *page = mapping;
+  if (page->magic != MAWIMCTL_STATE_PAGE_MAGIC ||
+      page->version != MAWIMCTL_STATE_PAGE_VERSION) {
+    fprintf(stderr, "mawimctl_state: \"%s\" is not a compatible state page\n",
+            name);
+    munmap(mapping, sizeof(mawimctl_state_page_t));
+    return NULL;
+  }
+
+  return page;
+}
+
+bool mawimctl_state_read(const mawimctl_state_page_t *page,
+                         mawimctl_state_page_t *dest) {
+  for (int attempt = 0; attempt < MAWIMCTL_STATE_READ_ATTEMPTS; attempt++) {
+    uint32_t before = __atomic_load_n(&page->sequence, __ATOMIC_ACQUIRE);
+    if (before & 1) {
+      continue;
+    }
+
+    memcpy(dest, page, sizeof(*dest));
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint32_t after = __atomic_load_n(&page->sequence, __ATOMIC_RELAXED);
+
+    if (before == after) {
+      dest->sequence = before;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void mawimctl_state_close(const mawimctl_state_page_t *page) {
+  if (page == NULL) {
+    return;
+  }
+
+  munmap((void *)page, sizeof(mawimctl_state_page_t));
+}
@@ -0,0 +1,39 @@
+/* mawimctl_state.h ; header for reading the MaWiM state page.
+ * See github.com/FelixEcker/mawim.git -> doc/mawimctl.md
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#ifndef MAWIMCTL_STATE_H
+#define MAWIMCTL_STATE_H
+
+#include "mawimctl.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Maps the state page MaWiM publishes its live state in
+ * @param name The name of the shared memory object, if NULL it will default to
+ * MAWIMCTL_DEFAULT_STATE_PAGE_NAME
+ * @return NULL on failure, the read-only mapping otherwise
+ */
+const mawimctl_state_page_t *mawimctl_state_open(const char *name);
+
+/**
+ * @brief Copies a consistent snapshot of the state page, no syscalls are made
+ * @param page The mapping returned by mawimctl_state_open()
+ * @param dest Where the snapshot should be written to
+ * @return false if no consistent snapshot could be taken
+ */
+bool mawimctl_state_read(const mawimctl_state_page_t *page,
+                         mawimctl_state_page_t *dest);
+
+/**
+ * @brief Unmaps the state page
+ * @param page The mapping returned by mawimctl_state_open()
+ */
+void mawimctl_state_close(const mawimctl_state_page_t *page);
+
+#endif /* #ifndef MAWIMCTL_STATE_H */
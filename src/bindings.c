@@ -0,0 +1,177 @@
+/* bindings.c ; MaWiM key bindings
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "bindings.h"
+
+#include "commands.h"
+#include "logging.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Modifiers that take part in matching a bind */
+#define _BIND_MODIFIERS (ShiftMask | ControlMask | Mod1Mask | Mod4Mask)
+
+/* CapsLock and NumLock (Mod2 on practically every keymap) must not keep binds
+ * from triggering, so every bind is grabbed with all of their combinations.
+ */
+static const unsigned int bind_lock_masks[] = {0, LockMask, Mod2Mask,
+                                               LockMask | Mod2Mask};
+
+void mawim_grab_bind(mawim_t *mawim, const mawim_bind_t *bind) {
+  KeyCode keycode = XKeysymToKeycode(mawim->display, bind->keysym);
+  if (keycode == 0) {
+    mawim_logf(LOG_WARNING, "keysym 0x%x is not on the keyboard\n",
+               bind->keysym);
+    return;
+  }
+
+  for (size_t ix = 0; ix < sizeof(bind_lock_masks) / sizeof(*bind_lock_masks);
+       ix++) {
+    XGrabKey(mawim->display, keycode, bind->modifiers | bind_lock_masks[ix],
+             mawim->root, true, GrabModeAsync, GrabModeAsync);
+  }
+}
+
+void mawim_ungrab_bind(mawim_t *mawim, const mawim_bind_t *bind) {
+  KeyCode keycode = XKeysymToKeycode(mawim->display, bind->keysym);
+  if (keycode == 0) {
+    return;
+  }
+
+  for (size_t ix = 0; ix < sizeof(bind_lock_masks) / sizeof(*bind_lock_masks);
+       ix++) {
+    XUngrabKey(mawim->display, keycode, bind->modifiers | bind_lock_masks[ix],
+               mawim->root);
+  }
+}
+
+void mawim_grab_binds(mawim_t *mawim) {
+  for (uint32_t ix = 0; ix < mawim->config.bind_count; ix++) {
+    mawim_grab_bind(mawim, &mawim->config.binds[ix]);
+  }
+
+  mawim_logf(LOG_DEBUG, "grabbed %d binds\n", mawim->config.bind_count);
+}
+
+bool _bind_keys_in(const mawim_config_t *config, const mawim_bind_t *bind) {
+  for (uint32_t ix = 0; ix < config->bind_count; ix++) {
+    if (config->binds[ix].keysym == bind->keysym &&
+        config->binds[ix].modifiers == bind->modifiers) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+int mawim_regrab_binds(mawim_t *mawim, const mawim_config_t *next) {
+  const mawim_config_t *live = &mawim->config;
+  int changed = 0;
+
+  for (uint32_t ix = 0; ix < live->bind_count; ix++) {
+    if (!_bind_keys_in(next, &live->binds[ix])) {
+      mawim_ungrab_bind(mawim, &live->binds[ix]);
+      changed++;
+    }
+  }
+
+  for (uint32_t ix = 0; ix < next->bind_count; ix++) {
+    if (!_bind_keys_in(live, &next->binds[ix])) {
+      mawim_grab_bind(mawim, &next->binds[ix]);
+      changed++;
+    }
+  }
+
+  return changed;
+}
+
+void _bind_exec(mawim_t *mawim, const char *command) {
+  /* Replays run without a mawimctl server, recorded key presses must not
+   * spawn the programs again.
+   */
+  if (mawim->mawimctl == NULL) {
+    return;
+  }
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    mawim_logf(LOG_ERROR, "failed to fork for \"%s\": %s\n", command,
+               strerror(errno));
+    return;
+  }
+
+  if (pid == 0) {
+    close(ConnectionNumber(mawim->display));
+    signal(SIGCHLD, SIG_DFL);
+    setsid();
+    execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+    _exit(127);
+  }
+
+  mawim_logf(LOG_DEBUG, "spawned \"%s\" as %d\n", command, pid);
+}
+
+/* Runs the action as the equivalent mawimctl command */
+void _bind_command(mawim_t *mawim, uint8_t identifier, uint8_t *data,
+                   uint16_t data_length) {
+  mawimctl_command_t cmd = {.sender_fd = -1,
+                            .command_identifier = identifier,
+                            .flags = MAWIMCTL_FLAG_NO_RESPONSE,
+                            .data_length = data_length,
+                            .data = data};
+  mawim_handle_ctl_command(mawim, cmd);
+}
+
+bool mawim_run_bind(mawim_t *mawim, XKeyEvent event) {
+  unsigned int modifiers = event.state & _BIND_MODIFIERS;
+
+  const mawim_bind_t *bind = NULL;
+  for (uint32_t ix = 0; ix < mawim->config.bind_count; ix++) {
+    const mawim_bind_t *candidate = &mawim->config.binds[ix];
+    if (candidate->modifiers == modifiers &&
+        XKeysymToKeycode(mawim->display, candidate->keysym) == event.keycode) {
+      bind = candidate;
+      break;
+    }
+  }
+
+  if (bind == NULL) {
+    return false;
+  }
+
+  uint8_t workspace = bind->workspace;
+  switch (bind->action) {
+  case MAWIM_BIND_EXEC:
+    _bind_exec(mawim, mawim_config_bind_command(&mawim->config, bind));
+    break;
+  case MAWIM_BIND_QUIT:
+    mawim_log(LOG_INFO, "quitting on bind\n");
+    mawim->running = false;
+    break;
+  case MAWIM_BIND_RELOAD:
+    _bind_command(mawim, MAWIMCTL_RELOAD, NULL, 0);
+    break;
+  case MAWIM_BIND_CLOSE_FOCUSED:
+    _bind_command(mawim, MAWIMCTL_CLOSE_FOCUSED, NULL, 0);
+    break;
+  case MAWIM_BIND_SET_WORKSPACE:
+    _bind_command(mawim, MAWIMCTL_SET_WORKSPACE, &workspace, 1);
+    break;
+  case MAWIM_BIND_MOVE_FOCUSED_TO_WORKSPACE:
+    _bind_command(mawim, MAWIMCTL_MOVE_FOCUSED_TO_WORKSPACE, &workspace, 1);
+    break;
+  default:
+    break;
+  }
+
+  return true;
+}
@@ -0,0 +1,55 @@
+/* bindings.h ; MaWiM key bindings
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#ifndef BINDINGS_H
+#define BINDINGS_H
+
+#include "config.h"
+#include "types.h"
+
+#include <X11/Xlib.h>
+
+/**
+ * @brief Grabs the keys of a bind on the root window. The bind also triggers
+ * with CapsLock or NumLock active.
+ * @param mawim The mawim instance
+ * @param bind The bind to be grabbed
+ */
+void mawim_grab_bind(mawim_t *mawim, const mawim_bind_t *bind);
+
+/**
+ * @brief Releases the grab of a bind
+ * @param mawim The mawim instance
+ * @param bind The bind to be released
+ */
+void mawim_ungrab_bind(mawim_t *mawim, const mawim_bind_t *bind);
+
+/**
+ * @brief Grabs the keys of every bind in the active configuration
+ * @param mawim The mawim instance
+ */
+void mawim_grab_binds(mawim_t *mawim);
+
+/**
+ * @brief Releases the grabs of binds which are not in the next configuration
+ * and grabs those which are new. Binds whose keys stay the same keep their
+ * grab even if their action changed.
+ * @param mawim The mawim instance, still holding the active configuration
+ * @param next The configuration about to become active
+ * @return The amount of grabs changed
+ */
+int mawim_regrab_binds(mawim_t *mawim, const mawim_config_t *next);
+
+/**
+ * @brief Runs the bind matching a key press
+ * @param mawim The mawim instance
+ * @param event The key press
+ * @return true if a bind matched
+ */
+bool mawim_run_bind(mawim_t *mawim, XKeyEvent event);
+
+#endif /* #ifndef BINDINGS_H */
@@ -10,12 +10,44 @@
 #include "logging.h"
 #include "mawim.h"
 #include "mawimctl_server.h"
+#include "metrics.h"
+#include "trace.h"
 #include "types.h"
 #include "window.h"
+#include "workspace.h"
 #include "xmem.h"
 
 #include <string.h>
 
+const char *ctl_command_str[MAWIMCTL_CMD_INVALID + 1] = {
+    "MAWIMCTL_GET_VERSION",
+    "MAWIMCTL_GET_WORKSPACE",
+    "MAWIMCTL_SET_WORKSPACE",
+    "MAWIMCTL_RELOAD",
+    "MAWIMCTL_CLOSE_FOCUSED",
+    "MAWIMCTL_MOVE_FOCUSED_TO_WORKSPACE",
+    "MAWIMCTL_GET_TRACE",
+    "MAWIMCTL_GET_METRICS",
+    "MAWIMCTL_SUBSCRIBE",
+    "MAWIMCTL_GET_STATE",
+    "MAWIMCTL_CMD_INVALID"};
+
+void mawim_publish_event(mawim_t *mawim, uint8_t type,
+                         mawimctl_workspaceid_t workspace,
+                         mawimctl_workspaceid_t previous_workspace,
+                         Window window) {
+  if (mawim->mawimctl == NULL || mawim->mawimctl->subscriber_count == 0) {
+    return;
+  }
+
+  mawimctl_event_t event = {.type = type,
+                            .workspace = workspace,
+                            .previous_workspace = previous_workspace,
+                            .reserved = 0,
+                            .window = window};
+  mawimctl_server_publish(mawim->mawimctl, &event);
+}
+
 mawimctl_response_t handle_set_workspace(mawim_t *mawim,
                                          mawimctl_command_t cmd) {
   mawimctl_response_t resp = mawimctl_generic_ok_response;
@@ -31,12 +63,28 @@ mawimctl_response_t handle_set_workspace(mawim_t *mawim,
   }
 
   uint8_t wanted_workspace = cmd.data[0];
-  if (wanted_workspace > mawim->workspace_count) {
+  if (wanted_workspace < 1 || wanted_workspace > mawim->workspace_count) {
     return mawimctl_no_such_workspace_response;
   }
 
-  mawim->active_workspace = wanted_workspace;
-  mawim_update_all_windows(mawim);
+  mawim_activate_workspace(mawim, wanted_workspace);
+
+  return resp;
+}
+
+mawimctl_response_t handle_reload(mawim_t *mawim, mawimctl_command_t cmd) {
+  mawimctl_response_t resp = mawimctl_generic_ok_response;
+
+  switch (mawim_reload_config(mawim)) {
+  case MAWIM_CONFIG_MISSING:
+    resp.status = MAWIMCTL_CONFIG_MISSING;
+    break;
+  case MAWIM_CONFIG_MALFORMED:
+    resp.status = MAWIMCTL_CONFIG_MALFORMED;
+    break;
+  default:
+    break;
+  }
 
   return resp;
 }
@@ -45,7 +93,8 @@ mawimctl_response_t handle_close_focused(mawim_t *mawim,
                                          mawimctl_command_t cmd) {
   mawimctl_response_t resp = mawimctl_generic_ok_response;
 
-  mawim_workspace_t *workspace = &mawim->workspaces[mawim->active_workspace];
+  mawim_workspace_t *workspace =
+      &mawim->workspaces[mawim->active_workspace - 1];
 
   if (workspace->focused_window == NULL) {
     resp.status = MAWIMCTL_NO_WINDOW_FOCUSED;
@@ -61,9 +110,18 @@ mawimctl_response_t handle_close_focused(mawim_t *mawim,
 mawimctl_response_t handle_move_focused_to_workspace(mawim_t *mawim,
                                                      mawimctl_command_t cmd) {
   mawimctl_response_t resp = mawimctl_generic_ok_response;
+  if (cmd.data_length != 1) {
+    return mawimctl_invalid_data_format_response;
+  }
+
+  if (cmd.data == NULL) {
+    mawim_log(LOG_ERROR, "handle_move_focused_to_workspace: cmd.data_length "
+                         "is 1 but cmd.data is NULL!\n");
+    return mawimctl_internal_error_response;
+  }
 
   uint8_t wanted_workspace = cmd.data[0];
-  if (wanted_workspace > mawim->workspace_count) {
+  if (wanted_workspace < 1 || wanted_workspace > mawim->workspace_count) {
     return mawimctl_no_such_workspace_response;
   }
 
@@ -81,6 +139,7 @@ mawimctl_response_t handle_move_focused_to_workspace(mawim_t *mawim,
 
   mawim_unmanage_window(mawim, window);
   mawim_remove_window(&workspace->windows, window->x11_window, false);
+  workspace->focused_window = NULL;
 
   window->workspace = wanted_workspace;
 
@@ -90,22 +149,162 @@ mawimctl_response_t handle_move_focused_to_workspace(mawim_t *mawim,
                window->x11_window, wanted_workspace);
   }
 
-  /* mawim_manage_window doesn't necessarily update all windows,
-   * so do that here again.
-   */
-  mawim_update_all_windows(mawim);
+  mawim_publish_event(mawim, MAWIMCTL_EVENT_WINDOW_MOVED, wanted_workspace,
+                      mawim->active_workspace, window->x11_window);
+  mawim_publish_event(mawim, MAWIMCTL_EVENT_FOCUS_CHANGED,
+                      mawim->active_workspace, 0, 0);
+
+  return resp;
+}
+
+mawimctl_response_t handle_get_state(mawim_t *mawim, mawimctl_command_t cmd) {
+  mawimctl_response_t resp = mawimctl_generic_ok_response;
+
+  mawimctl_state_header_t header = {.active_workspace = mawim->active_workspace,
+                                    .workspace_count = mawim->workspace_count,
+                                    .window_count = 0,
+                                    .flags = 0};
+
+  size_t windows_offs = sizeof(header) + mawim->workspace_count *
+                                             sizeof(mawimctl_state_workspace_t);
+  if (windows_offs > UINT16_MAX) {
+    return mawimctl_internal_error_response;
+  }
+
+  resp.data = xmalloc(UINT16_MAX);
+  size_t offs = windows_offs;
+
+  for (mawimctl_workspaceid_t wid = 1; wid <= mawim->workspace_count; wid++) {
+    mawim_workspace_t *workspace = &mawim->workspaces[wid - 1];
+    mawimctl_state_workspace_t ws = {
+        .id = wid,
+        .reserved = 0,
+        .row_count = workspace->row_count,
+        .active_row = workspace->active_row,
+        .window_count = 0,
+        .focused_window = workspace->focused_window != NULL
+                              ? workspace->focused_window->x11_window
+                              : 0};
+
+    for (mawim_window_t *current = workspace->windows.first; current != NULL;
+         current = current->next) {
+      if (offs + sizeof(mawimctl_state_window_t) > UINT16_MAX) {
+        header.flags |= MAWIMCTL_STATE_TRUNCATED;
+        break;
+      }
+
+      mawimctl_state_window_t win = {
+          .window = current->x11_window,
+          .workspace = wid,
+          .flags = (current->mapped ? MAWIMCTL_STATE_WINDOW_MAPPED : 0) |
+                   (current == workspace->focused_window
+                        ? MAWIMCTL_STATE_WINDOW_FOCUSED
+                        : 0),
+          .row = current->row,
+          .col = current->col,
+          .x = current->x,
+          .y = current->y,
+          .width = current->width,
+          .height = current->height,
+          .reserved = 0};
+
+      memcpy(resp.data + offs, &win, sizeof(win));
+      offs += sizeof(win);
+      ws.window_count++;
+      header.window_count++;
+    }
+
+    memcpy(resp.data + sizeof(header) + (wid - 1) * sizeof(ws), &ws,
+           sizeof(ws));
+  }
+
+  memcpy(resp.data, &header, sizeof(header));
+  resp.data_length = offs;
+
+  return resp;
+}
+
+mawimctl_response_t handle_subscribe(mawim_t *mawim, mawimctl_command_t cmd) {
+  uint8_t mask = MAWIMCTL_EVENT_MASK_ALL;
+  if (cmd.data_length == 1 && cmd.data != NULL) {
+    mask = cmd.data[0];
+  } else if (cmd.data_length != 0) {
+    return mawimctl_invalid_data_format_response;
+  }
+
+  if (mask & ~MAWIMCTL_EVENT_MASK_ALL) {
+    return mawimctl_invalid_data_format_response;
+  }
+
+  if (!mawimctl_server_subscribe(mawim->mawimctl, cmd.sender_fd, mask)) {
+    return mawimctl_internal_error_response;
+  }
+
+  return mawimctl_generic_ok_response;
+}
+
+mawimctl_response_t handle_get_trace(mawim_t *mawim, mawimctl_command_t cmd) {
+  mawimctl_response_t resp = mawimctl_generic_ok_response;
+
+  if (!mawim_trace_enabled) {
+    resp.status = MAWIMCTL_TRACING_DISABLED;
+    return resp;
+  }
+
+  resp.data = xmalloc(UINT16_MAX);
+  resp.data_length = mawim_trace_dump_json((char *)resp.data, UINT16_MAX) + 1;
+
+  return resp;
+}
+
+mawimctl_response_t handle_get_metrics(mawim_t *mawim,
+                                       mawimctl_command_t cmd) {
+  mawimctl_response_t resp = mawimctl_generic_ok_response;
+
+  uint8_t format = MAWIMCTL_METRICS_FORMAT_BINARY;
+  if (cmd.data_length == 1 && cmd.data != NULL) {
+    format = cmd.data[0];
+  }
+
+  mawim_metrics.x_requests = NextRequest(mawim->display) - 1;
+  mawim_metrics.command_queue_depth = mawim->mawimctl != NULL
+                                          ? mawim->mawimctl->pending_cmd_count
+                                          : 0;
+  mawim_metrics.command_queue_depth_max =
+      mawim->mawimctl != NULL ? mawim->mawimctl->pending_cmd_peak : 0;
+
+  switch (format) {
+  case MAWIMCTL_METRICS_FORMAT_BINARY:
+    resp.data_length = sizeof(mawim_metrics);
+    resp.data = xmalloc(resp.data_length);
+    memcpy(resp.data, &mawim_metrics, resp.data_length);
+    break;
+  case MAWIMCTL_METRICS_FORMAT_PROMETHEUS:
+    resp.data = xmalloc(UINT16_MAX);
+    resp.data_length =
+        mawim_metrics_prometheus(&mawim_metrics, (char *)resp.data,
+                                 UINT16_MAX) +
+        1;
+    break;
+  default:
+    return mawimctl_invalid_data_format_response;
+  }
 
   return resp;
 }
 
 bool mawim_handle_ctl_command(mawim_t *mawim, mawimctl_command_t cmd) {
   mawimctl_response_t resp = mawimctl_generic_ok_response;
+  uint64_t trace_begin = mawim_trace_begin();
+  uint64_t begin = mawim_metrics_now_ns();
+  /* Set for constant data, which is sent as is and not freed */
+  bool borrowed = false;
 
   switch (cmd.command_identifier) {
   case MAWIMCTL_GET_VERSION:
-    resp.data_length = sizeof(MAWIM_VERSION) + 1;
-    resp.data = xmalloc(resp.data_length);
-    memcpy(resp.data, MAWIM_VERSION, resp.data_length);
+    resp.data_length = sizeof(MAWIM_VERSION);
+    resp.data = (uint8_t *)MAWIM_VERSION;
+    borrowed = true;
     break;
   case MAWIMCTL_GET_WORKSPACE:
     resp.data_length = sizeof(mawim->active_workspace);
@@ -119,24 +318,45 @@ bool mawim_handle_ctl_command(mawim_t *mawim, mawimctl_command_t cmd) {
     resp = handle_close_focused(mawim, cmd);
     break;
   case MAWIMCTL_RELOAD:
-    mawim_log(LOG_DEBUG, "reloading is to be implemented!\n");
+    resp = handle_reload(mawim, cmd);
     break;
   case MAWIMCTL_MOVE_FOCUSED_TO_WORKSPACE:
     resp = handle_move_focused_to_workspace(mawim, cmd);
     break;
+  case MAWIMCTL_GET_TRACE:
+    resp = handle_get_trace(mawim, cmd);
+    break;
+  case MAWIMCTL_GET_METRICS:
+    resp = handle_get_metrics(mawim, cmd);
+    break;
+  case MAWIMCTL_SUBSCRIBE:
+    resp = handle_subscribe(mawim, cmd);
+    break;
+  case MAWIMCTL_GET_STATE:
+    resp = handle_get_state(mawim, cmd);
+    break;
   default:
     return false;
   }
 
+  mawim_trace_end(ctl_command_str[cmd.command_identifier], trace_begin);
+
+  mawim_metrics.commands_handled[cmd.command_identifier]++;
+  uint64_t latency_us = (mawim_metrics_now_ns() - begin) / 1000;
+  mawim_metrics_histogram_add(mawim_metrics.command_latency_us, latency_us);
+  mawim_metrics.command_latency_us_sum += latency_us;
+
+  /* The server takes ownership of the data when responding */
   if (!(cmd.flags & MAWIMCTL_FLAG_NO_RESPONSE)) {
     bool resp_succ =
-        mawimctl_server_respond(mawim->mawimctl, cmd.sender_fd, resp);
+        borrowed ? mawimctl_server_respond_borrowed(mawim->mawimctl,
+                                                    cmd.sender_fd, resp)
+                 : mawimctl_server_respond(mawim->mawimctl, cmd.sender_fd,
+                                           resp);
     if (!resp_succ) {
       mawim_log(LOG_ERROR, "failed to send mawimctl response!\n");
     }
-  }
-
-  if (resp.data != NULL) {
+  } else if (resp.data != NULL && !borrowed) {
     xfree(resp.data);
   }
 
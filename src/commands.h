@@ -10,6 +10,8 @@
 
 #include "types.h"
 
+extern const char *ctl_command_str[];
+
 /**
  * @brief handles the passed mawimctl command
  * @param mawim The mawim instance
@@ -18,4 +20,18 @@
  */
 bool mawim_handle_ctl_command(mawim_t *mawim, mawimctl_command_t cmd);
 
+/**
+ * @brief Pushes an event to all mawimctl clients subscribed to its type
+ * @param mawim The mawim instance
+ * @param type The mawimctl_event_type
+ * @param workspace The workspace the event happened on
+ * @param previous_workspace The workspace switched or moved away from, 0 for
+ * other event types
+ * @param window The X11 window the event is about, 0 if none
+ */
+void mawim_publish_event(mawim_t *mawim, uint8_t type,
+                         mawimctl_workspaceid_t workspace,
+                         mawimctl_workspaceid_t previous_workspace,
+                         Window window);
+
 #endif /* #ifndef COMMANDS_H */
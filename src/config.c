@@ -0,0 +1,858 @@
+/* config.c ; MaWiM configuration loading
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "config.h"
+
+#include "logging.h"
+#include "metrics.h"
+#include "xmem.h"
+
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define _CONFIG_WORD_MAX 64
+
+/* clang-format off */
+
+typedef struct config_parser {
+  const char     *pos;
+  const char     *end;
+  int             line;
+  char            sector[_CONFIG_WORD_MAX];
+  char            section[_CONFIG_WORD_MAX];
+  mawim_config_t *config;
+} config_parser_t;
+
+typedef struct config_number {
+  const char *section;
+  const char *name;
+  size_t      offset;
+  uint32_t    min;
+  uint32_t    max;
+} config_number_t;
+
+typedef struct config_name {
+  const char *name;
+  uint32_t    value;
+} config_name_t;
+
+/* clang-format on */
+
+static const config_number_t config_numbers[] = {
+    {"layout", "max_cols", offsetof(mawim_config_t, max_cols), 1, 64},
+    {"layout", "max_rows", offsetof(mawim_config_t, max_rows), 1, 64},
+    {"layout", "workspace_count", offsetof(mawim_config_t, workspace_count), 1,
+     MAWIM_CONFIG_MAX_WORKSPACES},
+    {"bordering", "top_gap", offsetof(mawim_config_t, top_gap), 0, 4096},
+    {"bordering", "bottom_gap", offsetof(mawim_config_t, bottom_gap), 0, 4096},
+    {"bordering", "left_gap", offsetof(mawim_config_t, left_gap), 0, 4096},
+    {"bordering", "right_gap", offsetof(mawim_config_t, right_gap), 0, 4096},
+    {"bordering", "border_width", offsetof(mawim_config_t, border_width), 0,
+     64},
+};
+
+static const config_name_t config_modifiers[] = {
+    {"super", Mod4Mask}, {"shift", ShiftMask}, {"ctrl", ControlMask},
+    {"control", ControlMask}, {"alt", Mod1Mask},
+};
+
+/* Lowercase names for keysyms which are capitalised in X11 */
+static const config_name_t config_keys[] = {
+    {"enter", XK_Return},        {"return", XK_Return},
+    {"space", XK_space},         {"tab", XK_Tab},
+    {"esc", XK_Escape},          {"escape", XK_Escape},
+    {"backspace", XK_BackSpace}, {"delete", XK_Delete},
+};
+
+static const config_name_t config_actions[] = {
+    {"exec", MAWIM_BIND_EXEC},
+    {"quit", MAWIM_BIND_QUIT},
+    {"reload", MAWIM_BIND_RELOAD},
+    {"close_focused", MAWIM_BIND_CLOSE_FOCUSED},
+    {"set_workspace", MAWIM_BIND_SET_WORKSPACE},
+    {"move_focused_to_workspace", MAWIM_BIND_MOVE_FOCUSED_TO_WORKSPACE},
+};
+
+#define _CONFIG_NAMES_LENGTH(names) (sizeof(names) / sizeof(names[0]))
+
+uint64_t _config_hash(const void *data, size_t length) {
+  /* FNV-1a */
+  const uint8_t *bytes = data;
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t ix = 0; ix < length; ix++) {
+    hash ^= bytes[ix];
+    hash *= 0x100000001b3;
+  }
+
+  return hash;
+}
+
+bool _config_lookup(const config_name_t *names, size_t count, const char *name,
+                    uint32_t *out) {
+  for (size_t ix = 0; ix < count; ix++) {
+    if (strcmp(names[ix].name, name) == 0) {
+      *out = names[ix].value;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* parsing */
+
+bool _config_is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+void _config_skip_space(config_parser_t *parser) {
+  while (parser->pos < parser->end && _config_is_space(*parser->pos)) {
+    if (*parser->pos == '\n') {
+      parser->line++;
+    }
+    parser->pos++;
+  }
+}
+
+/* Reads the next word, returns false at the end of the source or if the word
+ * does not fit
+ */
+bool _config_next_word(config_parser_t *parser, char *out) {
+  _config_skip_space(parser);
+
+  size_t length = 0;
+  while (parser->pos < parser->end && !_config_is_space(*parser->pos)) {
+    if (length + 1 >= _CONFIG_WORD_MAX) {
+      return false;
+    }
+    out[length++] = *parser->pos++;
+  }
+
+  out[length] = 0;
+  return length > 0;
+}
+
+/* Reads a value, either a word or a single quoted string which may span
+ * multiple lines. The value points into the source.
+ */
+bool _config_next_value(config_parser_t *parser, const char **out,
+                        size_t *out_length) {
+  _config_skip_space(parser);
+  if (parser->pos >= parser->end) {
+    return false;
+  }
+
+  if (*parser->pos != '\'') {
+    *out = parser->pos;
+    while (parser->pos < parser->end && !_config_is_space(*parser->pos) &&
+           *parser->pos != ',') {
+      parser->pos++;
+    }
+    *out_length = parser->pos - *out;
+    return true;
+  }
+
+  parser->pos++;
+  *out = parser->pos;
+  while (parser->pos < parser->end && *parser->pos != '\'') {
+    if (*parser->pos == '\n') {
+      parser->line++;
+    }
+    parser->pos++;
+  }
+
+  if (parser->pos >= parser->end) {
+    return false;
+  }
+
+  *out_length = parser->pos - *out;
+  parser->pos++;
+  return true;
+}
+
+bool _config_parse_color(const char *value, size_t length, uint32_t *out) {
+  if (length != 7 || value[0] != '#') {
+    return false;
+  }
+
+  uint32_t color = 0;
+  for (size_t ix = 1; ix < length; ix++) {
+    char c = value[ix];
+    uint32_t digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      return false;
+    }
+    color = (color << 4) | digit;
+  }
+
+  *out = color;
+  return true;
+}
+
+bool _config_parse_number(const char *value, size_t length, uint32_t *out) {
+  if (length == 0 || length > 10) {
+    return false;
+  }
+
+  uint64_t number = 0;
+  for (size_t ix = 0; ix < length; ix++) {
+    if (value[ix] < '0' || value[ix] > '9') {
+      return false;
+    }
+    number = number * 10 + (value[ix] - '0');
+  }
+
+  if (number > UINT32_MAX) {
+    return false;
+  }
+
+  *out = number;
+  return true;
+}
+
+/* Parses a single line of the binds string, e.g. "super shift 1
+ * move_focused_to_workspace 1"
+ */
+bool _config_parse_bind(config_parser_t *parser, const char *line,
+                        size_t length, int line_number) {
+  mawim_config_t *config = parser->config;
+  mawim_bind_t bind = {0};
+  char word[_CONFIG_WORD_MAX];
+  size_t pos = 0;
+
+  /* Modifiers, the key and the action */
+  int words = 0;
+  while (words < 2) {
+    while (pos < length && _config_is_space(line[pos])) {
+      pos++;
+    }
+
+    size_t word_length = 0;
+    while (pos < length && !_config_is_space(line[pos])) {
+      if (word_length + 1 >= sizeof(word)) {
+        mawim_logf(LOG_ERROR, "config:%d: bind word is too long\n",
+                   line_number);
+        return false;
+      }
+      word[word_length++] = line[pos++];
+    }
+    word[word_length] = 0;
+
+    if (word_length == 0) {
+      mawim_logf(LOG_ERROR, "config:%d: bind is missing a %s\n", line_number,
+                 words == 0 ? "key" : "action");
+      return false;
+    }
+
+    uint32_t value;
+    if (words == 0 && _config_lookup(config_modifiers,
+                                     _CONFIG_NAMES_LENGTH(config_modifiers),
+                                     word, &value)) {
+      bind.modifiers |= value;
+      continue;
+    }
+
+    if (words == 0) {
+      if (!_config_lookup(config_keys, _CONFIG_NAMES_LENGTH(config_keys), word,
+                          &value)) {
+        value = XStringToKeysym(word);
+      }
+
+      if (value == NoSymbol) {
+        mawim_logf(LOG_ERROR, "config:%d: unknown key \"%s\"\n", line_number,
+                   word);
+        return false;
+      }
+
+      bind.keysym = value;
+    } else {
+      if (!_config_lookup(config_actions,
+                          _CONFIG_NAMES_LENGTH(config_actions), word,
+                          &value)) {
+        mawim_logf(LOG_ERROR, "config:%d: unknown bind action \"%s\"\n",
+                   line_number, word);
+        return false;
+      }
+
+      bind.action = value;
+    }
+
+    words++;
+  }
+
+  /* The rest of the line is the argument */
+  while (pos < length && _config_is_space(line[pos])) {
+    pos++;
+  }
+  while (length > pos && _config_is_space(line[length - 1])) {
+    length--;
+  }
+
+  const char *argument = line + pos;
+  size_t argument_length = length - pos;
+
+  switch (bind.action) {
+  case MAWIM_BIND_EXEC:
+    if (argument_length == 0) {
+      mawim_logf(LOG_ERROR, "config:%d: exec is missing a command\n",
+                 line_number);
+      return false;
+    }
+
+    if (config->strings_used + argument_length + 1 >
+        MAWIM_CONFIG_STRINGS_SIZE) {
+      mawim_logf(LOG_ERROR, "config:%d: exec commands exceed %d bytes\n",
+                 line_number, MAWIM_CONFIG_STRINGS_SIZE);
+      return false;
+    }
+
+    bind.command = config->strings_used;
+    memcpy(config->strings + config->strings_used, argument, argument_length);
+    config->strings[config->strings_used + argument_length] = 0;
+    config->strings_used += argument_length + 1;
+    break;
+  case MAWIM_BIND_SET_WORKSPACE:
+  case MAWIM_BIND_MOVE_FOCUSED_TO_WORKSPACE: {
+    uint32_t workspace;
+    if (!_config_parse_number(argument, argument_length, &workspace) ||
+        workspace < 1 || workspace > MAWIM_CONFIG_MAX_WORKSPACES) {
+      mawim_logf(LOG_ERROR, "config:%d: expected a workspace number\n",
+                 line_number);
+      return false;
+    }
+
+    bind.workspace = workspace;
+    break;
+  }
+  default:
+    if (argument_length > 0) {
+      mawim_logf(LOG_WARNING, "config:%d: ignoring bind argument\n",
+                 line_number);
+    }
+    break;
+  }
+
+  /* A later bind of the same keys replaces the earlier one */
+  for (uint32_t ix = 0; ix < config->bind_count; ix++) {
+    if (config->binds[ix].keysym == bind.keysym &&
+        config->binds[ix].modifiers == bind.modifiers) {
+      mawim_logf(LOG_WARNING, "config:%d: keys are bound twice\n",
+                 line_number);
+      config->binds[ix] = bind;
+      return true;
+    }
+  }
+
+  if (config->bind_count >= MAWIM_CONFIG_MAX_BINDS) {
+    mawim_logf(LOG_ERROR, "config:%d: more than %d binds\n", line_number,
+               MAWIM_CONFIG_MAX_BINDS);
+    return false;
+  }
+
+  config->binds[config->bind_count++] = bind;
+  return true;
+}
+
+bool _config_parse_binds(config_parser_t *parser, const char *value,
+                         size_t length, int first_line) {
+  parser->config->bind_count = 0;
+  parser->config->strings_used = 0;
+
+  int line_number = first_line;
+  size_t line_start = 0;
+  for (size_t ix = 0; ix <= length; ix++) {
+    if (ix < length && value[ix] != '\n') {
+      continue;
+    }
+
+    const char *line = value + line_start;
+    size_t line_length = ix - line_start;
+    line_start = ix + 1;
+
+    size_t skip = 0;
+    while (skip < line_length && _config_is_space(line[skip])) {
+      skip++;
+    }
+
+    if (skip < line_length &&
+        !_config_parse_bind(parser, line, line_length, line_number)) {
+      return false;
+    }
+
+    line_number++;
+  }
+
+  return true;
+}
+
+bool _config_set_field(config_parser_t *parser, const char *type,
+                       const char *name, const char *value, size_t length,
+                       int line) {
+  mawim_config_t *config = parser->config;
+  bool is_string = strcmp(type, "str") == 0;
+
+  if (strcmp(parser->sector, "mawim") != 0) {
+    mawim_logf(LOG_WARNING, "config:%d: ignoring field outside of sector "
+                            "mawim\n",
+               line);
+    return true;
+  }
+
+  for (size_t ix = 0; ix < _CONFIG_NAMES_LENGTH(config_numbers); ix++) {
+    const config_number_t *number = &config_numbers[ix];
+    if (strcmp(number->section, parser->section) != 0 ||
+        strcmp(number->name, name) != 0) {
+      continue;
+    }
+
+    uint32_t parsed;
+    if (is_string || !_config_parse_number(value, length, &parsed) ||
+        parsed < number->min || parsed > number->max) {
+      mawim_logf(LOG_ERROR, "config:%d: %s has to be a number from %u to %u\n",
+                 line, name, number->min, number->max);
+      return false;
+    }
+
+    *(uint32_t *)((uint8_t *)config + number->offset) = parsed;
+    return true;
+  }
+
+  if (strcmp(parser->section, "bordering") == 0 &&
+      (strcmp(name, "active_border_color") == 0 ||
+       strcmp(name, "inactive_border_color") == 0)) {
+    uint32_t *color = name[0] == 'a' ? &config->active_border_color
+                                     : &config->inactive_border_color;
+    if (!is_string || !_config_parse_color(value, length, color)) {
+      mawim_logf(LOG_ERROR, "config:%d: %s has to be a '#rrggbb' string\n",
+                 line, name);
+      return false;
+    }
+
+    return true;
+  }
+
+  if (strcmp(parser->section, "bind") == 0 && strcmp(name, "binds") == 0) {
+    if (!is_string) {
+      mawim_logf(LOG_ERROR, "config:%d: binds has to be a string\n", line);
+      return false;
+    }
+
+    return _config_parse_binds(parser, value, length, line);
+  }
+
+  mawim_logf(LOG_WARNING, "config:%d: ignoring unknown field %s/%s\n", line,
+             parser->section, name);
+  return true;
+}
+
+/* Also used on configurations mapped from the cache, so nothing the parser
+ * guarantees is taken for granted.
+ */
+bool _config_validate(const mawim_config_t *config) {
+  for (size_t ix = 0; ix < _CONFIG_NAMES_LENGTH(config_numbers); ix++) {
+    const config_number_t *number = &config_numbers[ix];
+    uint32_t value = *(const uint32_t *)((const uint8_t *)config +
+                                         number->offset);
+    if (value < number->min || value > number->max) {
+      mawim_logf(LOG_ERROR, "config: %s is %u, not from %u to %u\n",
+                 number->name, value, number->min, number->max);
+      return false;
+    }
+  }
+
+  if (config->active_border_color > 0xffffff ||
+      config->inactive_border_color > 0xffffff) {
+    mawim_log(LOG_ERROR, "config: border color is not 0xrrggbb\n");
+    return false;
+  }
+
+  if (config->bind_count > MAWIM_CONFIG_MAX_BINDS ||
+      config->strings_used > MAWIM_CONFIG_STRINGS_SIZE) {
+    mawim_log(LOG_ERROR, "config: binds exceed their limits\n");
+    return false;
+  }
+
+  for (uint32_t ix = 0; ix < config->bind_count; ix++) {
+    const mawim_bind_t *bind = &config->binds[ix];
+    switch (bind->action) {
+    case MAWIM_BIND_EXEC:
+      if (bind->command >= config->strings_used ||
+          memchr(config->strings + bind->command, 0,
+                 config->strings_used - bind->command) == NULL) {
+        mawim_log(LOG_ERROR, "config: exec bind has no command\n");
+        return false;
+      }
+      break;
+    case MAWIM_BIND_SET_WORKSPACE:
+    case MAWIM_BIND_MOVE_FOCUSED_TO_WORKSPACE:
+      if (bind->workspace < 1 || bind->workspace > config->workspace_count) {
+        mawim_logf(LOG_ERROR,
+                   "config: bind targets workspace %d, there are only %d\n",
+                   bind->workspace, config->workspace_count);
+        return false;
+      }
+      break;
+    default:
+      if (bind->action >= MAWIM_BIND_ACTION_INVALID) {
+        mawim_logf(LOG_ERROR, "config: invalid bind action %d\n",
+                   bind->action);
+        return false;
+      }
+      break;
+    }
+  }
+
+  return true;
+}
+
+void mawim_config_defaults(mawim_config_t *config) {
+  memset(config, 0, sizeof(*config));
+
+  config->max_cols = 2;
+  config->max_rows = 3;
+  config->workspace_count = 2;
+  config->active_border_color = 0xff0000;
+  config->inactive_border_color = 0x333333;
+}
+
+const char *mawim_config_default_path(void) {
+  static char path[PATH_MAX];
+
+  const char *config_home = getenv("XDG_CONFIG_HOME");
+  const char *home = getenv("HOME");
+  int written;
+
+  if (config_home != NULL && config_home[0] != 0) {
+    written = snprintf(path, sizeof(path), "%s/mawim/config.mcfg", config_home);
+  } else if (home != NULL) {
+    written =
+        snprintf(path, sizeof(path), "%s/.config/mawim/config.mcfg", home);
+  } else {
+    return NULL;
+  }
+
+  return written > 0 && (size_t)written < sizeof(path) ? path : NULL;
+}
+
+int mawim_config_parse(const char *source, size_t length,
+                       mawim_config_t *config) {
+  config_parser_t parser = {
+      .pos = source,
+      .end = source + length,
+      .line = 1,
+      .sector = "",
+      .section = "",
+      .config = config,
+  };
+
+  char word[_CONFIG_WORD_MAX];
+  char name[_CONFIG_WORD_MAX];
+  while (_config_next_word(&parser, word)) {
+    int line = parser.line;
+
+    if (strcmp(word, "sector") == 0 || strcmp(word, "section") == 0) {
+      char *into =
+          strcmp(word, "sector") == 0 ? parser.sector : parser.section;
+      if (!_config_next_word(&parser, into)) {
+        mawim_logf(LOG_ERROR, "config:%d: expected a %s name\n", line, word);
+        return MAWIM_CONFIG_MALFORMED;
+      }
+      continue;
+    }
+
+    if (strcmp(word, "end") == 0) {
+      /* Sections end before their sector */
+      if (parser.section[0] != 0) {
+        parser.section[0] = 0;
+      } else {
+        parser.sector[0] = 0;
+      }
+      continue;
+    }
+
+    /* Fields, lists are not used by MaWiM and skipped */
+    bool is_list = strcmp(word, "list") == 0;
+    if (is_list && !_config_next_word(&parser, word)) {
+      mawim_logf(LOG_ERROR, "config:%d: expected a type\n", line);
+      return MAWIM_CONFIG_MALFORMED;
+    }
+
+    const char *value;
+    size_t value_length;
+    if (!_config_next_word(&parser, name) ||
+        !_config_next_value(&parser, &value, &value_length)) {
+      mawim_logf(LOG_ERROR, "config:%d: expected \"TYPE NAME VALUE\"\n", line);
+      return MAWIM_CONFIG_MALFORMED;
+    }
+
+    if (is_list) {
+      _config_skip_space(&parser);
+      while (parser.pos < parser.end && *parser.pos == ',') {
+        parser.pos++;
+        if (!_config_next_value(&parser, &value, &value_length)) {
+          mawim_logf(LOG_ERROR, "config:%d: unterminated list\n", line);
+          return MAWIM_CONFIG_MALFORMED;
+        }
+        _config_skip_space(&parser);
+      }
+
+      mawim_logf(LOG_WARNING, "config:%d: ignoring list %s\n", line, name);
+      continue;
+    }
+
+    if (!_config_set_field(&parser, word, name, value, value_length, line)) {
+      return MAWIM_CONFIG_MALFORMED;
+    }
+  }
+
+  if (parser.pos < parser.end) {
+    mawim_logf(LOG_ERROR, "config:%d: word is too long\n", parser.line);
+    return MAWIM_CONFIG_MALFORMED;
+  }
+
+  return _config_validate(config) ? MAWIM_CONFIG_OK : MAWIM_CONFIG_MALFORMED;
+}
+
+/* cache */
+
+const char *_config_cache_path(void) {
+  static char path[PATH_MAX];
+
+  const char *cache_home = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  int written;
+
+  if (cache_home != NULL && cache_home[0] != 0) {
+    written = snprintf(path, sizeof(path), "%s/mawim/config.cache", cache_home);
+  } else if (home != NULL) {
+    written =
+        snprintf(path, sizeof(path), "%s/.cache/mawim/config.cache", home);
+  } else {
+    return NULL;
+  }
+
+  return written > 0 && (size_t)written < sizeof(path) ? path : NULL;
+}
+
+/* Maps the cache if it is one for the current configuration layout and was
+ * built from the file at the same path. The caller unmaps it.
+ */
+const mawim_config_cache_header_t *
+_config_map_cache(const char *path, const mawim_config_cache_header_t *wanted) {
+  const size_t size = sizeof(*wanted) + sizeof(mawim_config_t);
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size != size) {
+    close(fd);
+    return NULL;
+  }
+
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+
+  const mawim_config_cache_header_t *header = mapping;
+  if (header->magic != wanted->magic || header->version != wanted->version ||
+      header->config_size != wanted->config_size ||
+      header->path_hash != wanted->path_hash) {
+    munmap(mapping, size);
+    return NULL;
+  }
+
+  return header;
+}
+
+void _config_write_cache(const char *path,
+                         const mawim_config_cache_header_t *header,
+                         const mawim_config_t *config) {
+  char tmp_path[PATH_MAX];
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >=
+      (int)sizeof(tmp_path)) {
+    return;
+  }
+
+  /* Create the parent directories */
+  for (char *slash = strchr(tmp_path + 1, '/'); slash != NULL;
+       slash = strchr(slash + 1, '/')) {
+    *slash = 0;
+    mkdir(tmp_path, 0755);
+    *slash = '/';
+  }
+
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    mawim_logf(LOG_WARNING, "could not write config cache \"%s\": %s\n",
+               tmp_path, strerror(errno));
+    return;
+  }
+
+  bool written = write(fd, header, sizeof(*header)) == sizeof(*header) &&
+                 write(fd, config, sizeof(*config)) == sizeof(*config);
+  close(fd);
+
+  /* Replace atomically so a concurrent startup never maps half a cache */
+  if (!written || rename(tmp_path, path) == -1) {
+    mawim_logf(LOG_WARNING, "could not write config cache \"%s\"\n", path);
+    unlink(tmp_path);
+  }
+}
+
+/* The cache is a plain file and may have been damaged or tampered with, it is
+ * only used if it would have passed as freshly parsed source.
+ */
+bool _config_load_cached(const mawim_config_cache_header_t *cached,
+                         mawim_config_t *config) {
+  memcpy(config, cached + 1, sizeof(*config));
+  if (_config_validate(config)) {
+    return true;
+  }
+
+  mawim_log(LOG_WARNING, "config cache is invalid, parsing the source\n");
+  mawim_config_defaults(config);
+  return false;
+}
+
+char *_config_read_source(int fd, size_t size) {
+  char *source = xmalloc(size > 0 ? size : 1);
+
+  size_t done = 0;
+  while (done < size) {
+    ssize_t got = read(fd, source + done, size - done);
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+
+    if (got <= 0) {
+      xfree(source);
+      return NULL;
+    }
+
+    done += got;
+  }
+
+  return source;
+}
+
+int mawim_config_load(const char *path, mawim_config_t *config) {
+  uint64_t begin = mawim_metrics_now_ns();
+  mawim_config_defaults(config);
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) == -1) {
+    mawim_logf(LOG_WARNING, "could not open config \"%s\": %s\n", path,
+               strerror(errno));
+    if (fd != -1) {
+      close(fd);
+    }
+    return MAWIM_CONFIG_MISSING;
+  }
+
+  mawim_config_cache_header_t header = {
+      .magic = MAWIM_CONFIG_CACHE_MAGIC,
+      .version = MAWIM_CONFIG_CACHE_VERSION,
+      .config_size = sizeof(mawim_config_t),
+      .reserved = 0,
+      .path_hash = _config_hash(path, strlen(path)),
+      .source_mtime_ns =
+          (uint64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec,
+      .source_size = st.st_size,
+      .source_hash = 0,
+  };
+
+  const char *cache_path = _config_cache_path();
+  const mawim_config_cache_header_t *cached =
+      cache_path != NULL ? _config_map_cache(cache_path, &header) : NULL;
+  const size_t cache_size = sizeof(header) + sizeof(mawim_config_t);
+
+  /* Unchanged since the cache was built, do not even read the source */
+  if (cached != NULL && cached->source_mtime_ns == header.source_mtime_ns &&
+      cached->source_size == header.source_size) {
+    bool valid = _config_load_cached(cached, config);
+    munmap((void *)cached, cache_size);
+    cached = NULL;
+
+    if (valid) {
+      close(fd);
+      mawim_logf(LOG_INFO, "loaded config \"%s\" from cache in %.3fms\n",
+                 path, (mawim_metrics_now_ns() - begin) / 1e6);
+      return MAWIM_CONFIG_OK;
+    }
+  }
+
+  char *source = _config_read_source(fd, st.st_size);
+  close(fd);
+  if (source == NULL) {
+    mawim_logf(LOG_ERROR, "could not read config \"%s\"\n", path);
+    if (cached != NULL) {
+      munmap((void *)cached, cache_size);
+    }
+    return MAWIM_CONFIG_MISSING;
+  }
+
+  header.source_hash = _config_hash(source, st.st_size);
+
+  int result;
+  const char *origin;
+  if (cached != NULL && cached->source_hash == header.source_hash &&
+      _config_load_cached(cached, config)) {
+    /* Only touched, the cache is rewritten to pick up the new mtime */
+    result = MAWIM_CONFIG_OK;
+    origin = "cache";
+  } else {
+    result = mawim_config_parse(source, st.st_size, config);
+    origin = "source";
+  }
+
+  if (cached != NULL) {
+    munmap((void *)cached, cache_size);
+  }
+  xfree(source);
+
+  if (result != MAWIM_CONFIG_OK) {
+    mawim_config_defaults(config);
+    return result;
+  }
+
+  if (cache_path != NULL) {
+    _config_write_cache(cache_path, &header, config);
+  }
+
+  mawim_logf(LOG_INFO, "loaded config \"%s\" from %s in %.3fms\n", path,
+             origin, (mawim_metrics_now_ns() - begin) / 1e6);
+  return MAWIM_CONFIG_OK;
+}
+
+const char *mawim_config_bind_command(const mawim_config_t *config,
+                                      const mawim_bind_t *bind) {
+  return config->strings + bind->command;
+}
@@ -0,0 +1,139 @@
+/* config.h ; MaWiM configuration loading
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAWIM_CONFIG_MAX_BINDS 64
+#define MAWIM_CONFIG_STRINGS_SIZE 4096
+#define MAWIM_CONFIG_MAX_WORKSPACES 255
+
+#define MAWIM_CONFIG_CACHE_MAGIC 0x4643574d /* "MWCF" */
+/* Bump whenever mawim_config_t changes so stale caches are not used */
+#define MAWIM_CONFIG_CACHE_VERSION 1
+
+enum mawim_config_result {
+  MAWIM_CONFIG_OK = 0,
+  MAWIM_CONFIG_MISSING,
+  MAWIM_CONFIG_MALFORMED,
+};
+
+enum mawim_bind_action {
+  MAWIM_BIND_EXEC = 0,
+  MAWIM_BIND_QUIT,
+  MAWIM_BIND_RELOAD,
+  MAWIM_BIND_CLOSE_FOCUSED,
+  MAWIM_BIND_SET_WORKSPACE,
+  MAWIM_BIND_MOVE_FOCUSED_TO_WORKSPACE,
+  MAWIM_BIND_ACTION_INVALID,
+};
+
+/* clang-format off */
+
+typedef struct mawim_bind {
+  uint32_t keysym;
+  uint16_t modifiers;
+  uint8_t  action;
+  /* Target of the workspace actions */
+  uint8_t  workspace;
+  /* Offset of the shell command in mawim_config_t.strings for exec */
+  uint32_t command;
+} mawim_bind_t;
+
+/* The configuration is kept flat and without pointers so that it can be
+ * written to and mapped from the cache as is.
+ */
+typedef struct mawim_config {
+  /* layout */
+  uint32_t max_cols;
+  uint32_t max_rows;
+  uint32_t workspace_count;
+
+  /* bordering */
+  uint32_t top_gap;
+  uint32_t bottom_gap;
+  uint32_t left_gap;
+  uint32_t right_gap;
+  uint32_t border_width;
+  /* 0xRRGGBB */
+  uint32_t active_border_color;
+  uint32_t inactive_border_color;
+
+  /* bind */
+  uint32_t     bind_count;
+  mawim_bind_t binds[MAWIM_CONFIG_MAX_BINDS];
+
+  /* NUL terminated strings referenced by offset */
+  uint32_t strings_used;
+  char     strings[MAWIM_CONFIG_STRINGS_SIZE];
+} mawim_config_t;
+
+typedef struct mawim_config_cache_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t config_size;
+  uint32_t reserved;
+
+  /* Identifies the source the cache was built from */
+  uint64_t path_hash;
+  uint64_t source_mtime_ns;
+  uint64_t source_size;
+  uint64_t source_hash;
+} mawim_config_cache_header_t;
+
+/* clang-format on */
+
+/**
+ * @brief Fills the configuration with the builtin defaults
+ * @param config The configuration to be filled
+ */
+void mawim_config_defaults(mawim_config_t *config);
+
+/**
+ * @brief Gets the configuration file used if none was passed, this is
+ * $XDG_CONFIG_HOME/mawim/config.mcfg or ~/.config/mawim/config.mcfg
+ * @return A static buffer holding the path, NULL if neither $XDG_CONFIG_HOME
+ * nor $HOME are set
+ */
+const char *mawim_config_default_path(void);
+
+/**
+ * @brief Parses mcfg source into a validated configuration. Unknown fields
+ * are warned about and skipped.
+ * @param source The mcfg text, does not have to be NUL terminated
+ * @param length The length of source
+ * @param config The configuration to be filled, starts out as the defaults
+ * @return MAWIM_CONFIG_OK or MAWIM_CONFIG_MALFORMED
+ */
+int mawim_config_parse(const char *source, size_t length,
+                       mawim_config_t *config);
+
+/**
+ * @brief Loads the configuration file. If the binary cache was built from the
+ * same file it is mapped instead of parsing the file, otherwise the file is
+ * parsed and the cache rewritten. If the file can not be loaded config is
+ * left at the defaults.
+ * @param path The configuration file
+ * @param config The configuration to be filled
+ * @return MAWIM_CONFIG_OK, MAWIM_CONFIG_MISSING or MAWIM_CONFIG_MALFORMED
+ */
+int mawim_config_load(const char *path, mawim_config_t *config);
+
+/**
+ * @brief Gets the shell command of an exec bind
+ * @param config The configuration the bind belongs to
+ * @param bind The bind
+ * @return The command
+ */
+const char *mawim_config_bind_command(const mawim_config_t *config,
+                                      const mawim_bind_t *bind);
+
+#endif /* #ifndef CONFIG_H */
@@ -16,6 +16,7 @@
 #define mawim_panic(msg)                                                       \
   mawim_logf(LOG_ERROR, "mawim panic'd at %s:%d: %s", __FILE__, __LINE__,      \
              msg);                                                             \
+  mawim_log_drain();                                                           \
   exit(EXIT_FAILURE);
 
 /**
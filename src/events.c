@@ -7,8 +7,12 @@
 
 #include "events.h"
 
+#include "bindings.h"
+#include "commands.h"
 #include "logging.h"
 #include "mawim.h"
+#include "metrics.h"
+#include "trace.h"
 #include "types.h"
 #include "window.h"
 #include "workspace.h"
@@ -31,6 +35,15 @@ void handle_button_press(mawim_t *mawim, XEvent event) {
   mawim_x11_flush(mawim);
 }
 
+void handle_key_press(mawim_t *mawim, XKeyEvent event) {
+  mawim_logf(LOG_DEBUG, "Got KeyPress (keycode %d, state 0x%x)!\n",
+             event.keycode, event.state);
+
+  if (!mawim_run_bind(mawim, event)) {
+    mawim_log(LOG_DEBUG, "KeyPress matches no bind!\n");
+  }
+}
+
 void handle_create_notify(mawim_t *mawim, XCreateWindowEvent event) {
   mawim_log(LOG_DEBUG, "Got CreateNotify!\n");
 }
@@ -43,6 +56,12 @@ void handle_destroy_notify(mawim_t *mawim, XDestroyWindowEvent event) {
       mawim_find_window_in_workspaces(mawim, event.window, NULL, &workspace);
 
   if (mawim_window != NULL) {
+    mawim_workspace_t *ws = &mawim->workspaces[workspace - 1];
+    if (ws->focused_window == mawim_window) {
+      ws->focused_window = NULL;
+      mawim_publish_event(mawim, MAWIMCTL_EVENT_FOCUS_CHANGED, workspace, 0, 0);
+    }
+
     mawim_unmanage_window(mawim, mawim_window);
     mawim_remove_window(&mawim->workspaces[workspace - 1].windows, event.window,
                         true);
@@ -85,11 +104,16 @@ void handle_configure_request(mawim_t *mawim, XConfigureRequestEvent event) {
     mawim_log(LOG_DEBUG, "Window is not being managed!\n");
   }
 
-  mawim_logf(
-      LOG_DEBUG,
-      "Configured Window 0x%08x to dimensions %dx%d at coordinates %dx%d\n",
-      event.window, mawim_win->changes.width, mawim_win->changes.height,
-      mawim_win->changes.x, mawim_win->changes.y);
+  /* The layout pass only configures what changed, so a window which already
+   * has its geometry would get no reply. ICCCM 4.1.5 wants a synthetic
+   * ConfigureNotify then.
+   */
+  if (mawim_win->configured) {
+    mawim_send_configure_notify(mawim, mawim_win, mawim->border_width);
+  }
+
+  mawim_logf(LOG_DEBUG, "Queued Window 0x%08x for layout on workspace %d\n",
+             event.window, mawim_win->workspace);
 }
 
 void handle_map_request(mawim_t *mawim, XMapRequestEvent event) {
@@ -97,9 +121,25 @@ void handle_map_request(mawim_t *mawim, XMapRequestEvent event) {
 
   XMapWindow(mawim->display, event.window);
 
+  mawim_window_t *mawim_win =
+      mawim_find_window_in_workspaces(mawim, event.window, NULL, NULL);
+  if (mawim_win != NULL) {
+    mawim_win->mapped = true;
+  }
+
   mawim_logf(LOG_DEBUG, "Mapped Window 0x%08x\n", event.window);
 }
 
+void handle_unmap_notify(mawim_t *mawim, XUnmapEvent event) {
+  mawim_logf(LOG_DEBUG, "Got UnmapNotify (window 0x%08x)!\n", event.window);
+
+  mawim_window_t *mawim_win =
+      mawim_find_window_in_workspaces(mawim, event.window, NULL, NULL);
+  if (mawim_win != NULL) {
+    mawim_win->mapped = false;
+  }
+}
+
 mawim_window_t *get_hovered_window(mawim_t *mawim, int x, int y) {
   mawim_window_t *match = NULL;
 
@@ -111,6 +151,7 @@ mawim_window_t *get_hovered_window(mawim_t *mawim, int x, int y) {
 
     XWindowAttributes attribs;
     XGetWindowAttributes(mawim->display, win, &attribs);
+    mawim_metrics.x_round_trips++;
 
     int wx = attribs.x;
     int wy = attribs.y;
@@ -140,11 +181,23 @@ void handle_leave_notify(mawim_t *mawim, XLeaveWindowEvent event) {
                  RevertToPointerRoot, CurrentTime);
   mawim_x11_flush(mawim);
 
-  mawim->workspaces[mawim->active_workspace - 1].focused_window = window;
-  if (mawim->workspaces[mawim->active_workspace - 1].focused_window == NULL) {
+  mawim_workspace_t *workspace = &mawim->workspaces[mawim->active_workspace - 1];
+  mawim_window_t *previous = workspace->focused_window;
+
+  workspace->focused_window = window;
+  if (workspace->focused_window == NULL) {
     mawim_log(LOG_WARNING, "newly focused window is not in window list!\n");
   }
 
+  if (window != previous) {
+    mawim_paint_window_border(mawim, previous);
+    mawim_paint_window_border(mawim, window);
+
+    mawim_publish_event(mawim, MAWIMCTL_EVENT_FOCUS_CHANGED,
+                        mawim->active_workspace, 0,
+                        window != NULL ? window->x11_window : 0);
+  }
+
   mawim_logf(LOG_DEBUG, "Set input focus to window 0x%08x\n", window);
 }
 
@@ -153,34 +206,60 @@ void handle_enter_notify(mawim_t *mawim, XEnterWindowEvent event) {
 }
 
 bool mawim_handle_event(mawim_t *mawim, XEvent event) {
+  uint64_t trace_begin = mawim_trace_begin();
+  uint64_t begin = mawim_metrics_now_ns();
+  bool handled = true;
+
   switch (event.type) {
+  case KeyPress:
+    handle_key_press(mawim, event.xkey);
+    break;
   case ButtonPress:
     handle_button_press(mawim, event);
-    return true;
+    break;
   case CreateNotify:
     handle_create_notify(mawim, event.xcreatewindow);
-    return true;
+    break;
   case DestroyNotify:
     handle_destroy_notify(mawim, event.xdestroywindow);
-    return true;
+    break;
   case ReparentNotify:
     handle_reparent_notify(mawim, event);
-    return true;
+    break;
   case ConfigureRequest:
     handle_configure_request(mawim, event.xconfigurerequest);
-    return true;
+    break;
   case MapRequest:
     handle_map_request(mawim, event.xmaprequest);
-    return true;
+    break;
+  case UnmapNotify:
+    handle_unmap_notify(mawim, event.xunmap);
+    break;
   case LeaveNotify:
     handle_leave_notify(mawim, event.xcrossing);
-    return true;
+    break;
   case EnterNotify:
     handle_enter_notify(mawim, event.xcrossing);
-    return true;
+    break;
   default:
-    return false;
+    handled = false;
+    break;
+  }
+
+  mawim_trace_end(event.type > 1 && event.type < LASTEvent
+                      ? event_type_str[event.type]
+                      : "UnknownEvent",
+                  trace_begin);
+
+  if (!handled) {
+    mawim_metrics.events_unhandled++;
+  } else if (event.type < MAWIMCTL_METRICS_EVENT_TYPES) {
+    mawim_metrics.events_handled[event.type]++;
   }
 
-  return true;
+  uint64_t latency_us = (mawim_metrics_now_ns() - begin) / 1000;
+  mawim_metrics_histogram_add(mawim_metrics.event_latency_us, latency_us);
+  mawim_metrics.event_latency_us_sum += latency_us;
+
+  return handled;
 }
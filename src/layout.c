@@ -0,0 +1,104 @@
+/* layout.c ; MaWiM Layout Engine
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#include "layout.h"
+
+#include "logging.h"
+#include "xmem.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+int mawim_layout_window_count(const mawim_layout_t *layout) {
+  int count = 0;
+  for (int row = 0; row < layout->row_count; row++) {
+    count += layout->row_lengths[row];
+  }
+
+  return count;
+}
+
+bool mawim_layout_tile(const mawim_layout_t *layout,
+                       mawim_geometry_table_t *table) {
+  table->count = 0;
+
+  if (layout->row_count < 1) {
+    return true;
+  }
+
+  const int row_height = layout->screen.height / layout->row_count;
+  const int hgaps = layout->left_gap + layout->right_gap;
+  const int vgaps = layout->top_gap + layout->bottom_gap;
+  /* X11 draws the border outside of the window size */
+  const int borders = 2 * layout->border_width;
+
+  int ix = 0;
+  for (int row = 0; row < layout->row_count; row++) {
+    const int cols = layout->row_lengths[row];
+    if (cols < 1) {
+      continue;
+    }
+
+    if (ix + cols > table->capacity) {
+      return false;
+    }
+
+    const int col_width = layout->screen.width / cols;
+    const int y = layout->screen.y + row_height * row + layout->top_gap;
+    const int height =
+        row_height - vgaps - borders > 0 ? row_height - vgaps - borders : 1;
+    const int width =
+        col_width - hgaps - borders > 0 ? col_width - hgaps - borders : 1;
+
+    for (int col = 0; col < cols; col++, ix++) {
+      table->x[ix] = layout->screen.x + col_width * col + layout->left_gap;
+      table->y[ix] = y;
+      table->width[ix] = width;
+      table->height[ix] = height;
+    }
+  }
+
+  table->count = ix;
+  return true;
+}
+
+void mawim_geometry_table_reserve(mawim_geometry_table_t *table,
+                                  int capacity) {
+  if (capacity <= table->capacity) {
+    return;
+  }
+
+  int new_capacity = table->capacity > 0 ? table->capacity : 16;
+  while (new_capacity < capacity) {
+    new_capacity *= 2;
+  }
+
+  table->x = xrealloc(table->x, new_capacity * sizeof(*table->x));
+  table->y = xrealloc(table->y, new_capacity * sizeof(*table->y));
+  table->width = xrealloc(table->width, new_capacity * sizeof(*table->width));
+  table->height =
+      xrealloc(table->height, new_capacity * sizeof(*table->height));
+  table->capacity = new_capacity;
+}
+
+void mawim_geometry_table_free(mawim_geometry_table_t *table) {
+  if (table->capacity == 0) {
+    return;
+  }
+
+  xfree(table->x);
+  xfree(table->y);
+  xfree(table->width);
+  xfree(table->height);
+
+  table->x = NULL;
+  table->y = NULL;
+  table->width = NULL;
+  table->height = NULL;
+  table->count = 0;
+  table->capacity = 0;
+}
@@ -0,0 +1,90 @@
+/* layout.h ; MaWiM Layout Engine
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stdbool.h>
+
+/* The layout engine does neither talk to the X server nor allocate memory
+ * (except for mawim_geometry_table_reserve()), it only turns a description of
+ * a workspace into window geometry.
+ */
+
+/* clang-format off */
+
+typedef struct mawim_layout_rect {
+  int x;
+  int y;
+  int width;
+  int height;
+} mawim_layout_rect_t;
+
+typedef struct mawim_layout {
+  mawim_layout_rect_t screen;
+
+  /* Gaps around every window */
+  int top_gap;
+  int bottom_gap;
+  int left_gap;
+  int right_gap;
+
+  /* Border drawn by the X server around every window */
+  int border_width;
+
+  /* Windows per row, row_lengths has row_count entries */
+  int        row_count;
+  const int *row_lengths;
+} mawim_layout_t;
+
+/* Geometry in struct-of-arrays form, entry n is the n-th window when walking
+ * the rows top to bottom and each row left to right.
+ */
+typedef struct mawim_geometry_table {
+  int  count;
+  int  capacity;
+  int *x;
+  int *y;
+  int *width;
+  int *height;
+} mawim_geometry_table_t;
+
+/* clang-format on */
+
+/**
+ * @brief Counts the windows described by the layout
+ * @param layout The layout description
+ * @return The amount of entries mawim_layout_tile() will produce
+ */
+int mawim_layout_window_count(const mawim_layout_t *layout);
+
+/**
+ * @brief Computes the tiled geometry of every window in one pass. Every row
+ * gets an equal share of the screen's height and every window an equal share
+ * of its row's width.
+ * @param layout The layout description
+ * @param table The table to write to, its count is set to the amount of
+ * entries written
+ * @return false if the table's capacity is too small
+ */
+bool mawim_layout_tile(const mawim_layout_t *layout,
+                       mawim_geometry_table_t *table);
+
+/**
+ * @brief Grows the table so that it can hold at least capacity entries
+ * @param table The table to grow
+ * @param capacity The wanted capacity
+ */
+void mawim_geometry_table_reserve(mawim_geometry_table_t *table, int capacity);
+
+/**
+ * @brief Frees the arrays of the table
+ * @param table The table to be freed
+ */
+void mawim_geometry_table_free(mawim_geometry_table_t *table);
+
+#endif /* #ifndef LAYOUT_H */
@@ -1,13 +1,75 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "logging.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "ansi.h"
 
 log_level_t mawim_log_level;
 
+/* Log calls only queue a record consisting of the format pointer and the raw
+ * arguments into a ring buffer. Formatting and writing happens in
+ * mawim_log_drain(), which the main loop calls before it goes idle.
+ *
+ * Every logging thread has a single producer/single consumer ring of its own,
+ * so queueing takes no lock. The main thread uses the first ring and drains
+ * it synchronously if it runs full. Other threads claim a ring with
+ * mawim_log_thread_init(), they never write out anything themselves and drop
+ * records while their ring is full. log_drain_lock serialises consumers.
+ *
+ * Records are 8 byte aligned and never wrap, a header with a format of NULL
+ * marks the rest of the buffer as unused.
+ */
+
+/* clang-format off */
+
+typedef struct log_record {
+  uint32_t    length;
+  uint8_t     level;
+  bool        noprefix;
+  uint16_t    argc;
+  const char *format;
+} log_record_t;
+
+typedef union log_arg {
+  long long           i;
+  unsigned long long  u;
+  double              f;
+  void               *p;
+  uint32_t            str_offs;
+} log_arg_t;
+
+typedef struct log_ring {
+  uint8_t       buffer[MAWIM_LOG_RING_SIZE] __attribute__((aligned(8)));
+  atomic_size_t head;
+  atomic_size_t tail;
+  atomic_ulong  dropped;
+} log_ring_t;
+
+/* clang-format on */
+
+static log_ring_t log_rings[MAWIM_LOG_THREADS];
+static atomic_int log_rings_used = 1;
+static _Thread_local log_ring_t *log_thread_ring = &log_rings[0];
+
+static pthread_mutex_t log_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int log_file_fd = -1;
+static char *log_file_path = NULL;
+static size_t log_file_size = 0;
+static size_t log_file_max_size = 0;
+
 log_level_t str_to_loglvl(char *str) {
   if (str == NULL)
     return LOG_DEBUG;
@@ -28,53 +90,524 @@ log_level_t str_to_loglvl(char *str) {
   }
 }
 
-int mawim_logf(log_level_t level, const char *format, ...) {
-  if (level < mawim_log_level)
-    return 0;
+/* format specification parsing */
 
-  char *level_prefix;
-  switch (level) {
-  default:
-  case LOG_DEBUG:
-    level_prefix = ANSI_BOLD ANSI_FG_CYAN "DBG" ANSI_RESET;
-    break;
-  case LOG_INFO:
-    level_prefix = ANSI_BOLD ANSI_FG_GREEN "INF" ANSI_RESET;
+/* Skips flags, width, precision and length modifiers of the conversion
+ * starting after the '%' at spec. Writes the amount of '*' arguments to stars
+ * and the length modifier to length.
+ */
+const char *_log_parse_spec(const char *spec, int *stars, char *length) {
+  *stars = 0;
+  *length = '\0';
+
+  while (strchr("-+ #0'", *spec) != NULL && *spec != '\0')
+    spec++;
+
+  for (int part = 0; part < 2; part++) {
+    if (part == 1) {
+      if (*spec != '.')
+        break;
+      spec++;
+    }
+
+    if (*spec == '*') {
+      (*stars)++;
+      spec++;
+    }
+
+    while (*spec >= '0' && *spec <= '9')
+      spec++;
+  }
+
+  switch (*spec) {
+  case 'h':
+    *length = spec[1] == 'h' ? 'H' : 'h';
+    spec += spec[1] == 'h' ? 2 : 1;
     break;
-  case LOG_WARNING:
-    level_prefix = ANSI_BOLD ANSI_FG_YELLOW "WRN" ANSI_RESET;
+  case 'l':
+    *length = spec[1] == 'l' ? 'q' : 'l';
+    spec += spec[1] == 'l' ? 2 : 1;
     break;
-  case LOG_ERROR:
-    level_prefix = ANSI_BOLD ANSI_FG_RED "ERR" ANSI_RESET;
+  case 'j':
+  case 'z':
+  case 't':
+  case 'L':
+    *length = *spec;
+    spec++;
     break;
   }
 
-  fprintf(stderr, "%s %s", level_prefix, ANSI_BOLD);
+  return spec;
+}
+
+/* record creation */
+
+size_t _log_free_space(size_t head, size_t tail) {
+  return MAWIM_LOG_RING_SIZE - (head - tail);
+}
+
+int _log_queue(log_level_t level, bool noprefix, const char *format,
+               va_list arg) {
+  log_arg_t args[MAWIM_LOG_MAX_ARGS];
+  char strings[MAWIM_LOG_MAX_STRINGS];
+  size_t strings_length = 0;
+  int argc = 0;
+  bool unsupported = false;
+
+  for (const char *c = format; *c != '\0'; c++) {
+    if (*c != '%')
+      continue;
+
+    c++;
+    if (*c == '%')
+      continue;
+
+    int stars;
+    char length;
+    c = _log_parse_spec(c, &stars, &length);
+
+    if (argc + stars + 1 > MAWIM_LOG_MAX_ARGS)
+      break;
+
+    for (int ix = 0; ix < stars; ix++)
+      args[argc++].i = va_arg(arg, int);
+
+    switch (*c) {
+    case 'd':
+    case 'i':
+    case 'c':
+      if (length == 'l')
+        args[argc].i = va_arg(arg, long);
+      else if (length == 'q')
+        args[argc].i = va_arg(arg, long long);
+      else if (length == 'j')
+        args[argc].i = va_arg(arg, intmax_t);
+      else if (length == 'z' || length == 't')
+        args[argc].i = va_arg(arg, ptrdiff_t);
+      else if (length == 'h')
+        args[argc].i = (short)va_arg(arg, int);
+      else if (length == 'H')
+        args[argc].i = (signed char)va_arg(arg, int);
+      else
+        args[argc].i = va_arg(arg, int);
+      break;
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+      if (length == 'l')
+        args[argc].u = va_arg(arg, unsigned long);
+      else if (length == 'q')
+        args[argc].u = va_arg(arg, unsigned long long);
+      else if (length == 'j')
+        args[argc].u = va_arg(arg, uintmax_t);
+      else if (length == 'z' || length == 't')
+        args[argc].u = va_arg(arg, size_t);
+      else if (length == 'h')
+        args[argc].u = (unsigned short)va_arg(arg, unsigned int);
+      else if (length == 'H')
+        args[argc].u = (unsigned char)va_arg(arg, unsigned int);
+      else
+        args[argc].u = va_arg(arg, unsigned int);
+      break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      if (length == 'L')
+        args[argc].f = (double)va_arg(arg, long double);
+      else
+        args[argc].f = va_arg(arg, double);
+      break;
+    case 'p':
+      args[argc].p = va_arg(arg, void *);
+      break;
+    case 's': {
+      const char *str = va_arg(arg, const char *);
+      if (str == NULL)
+        str = "(null)";
+
+      /* Out of string space, point to the previous terminator */
+      if (strings_length == MAWIM_LOG_MAX_STRINGS) {
+        args[argc].str_offs = strings_length - 1;
+        break;
+      }
+
+      size_t len = strnlen(str, MAWIM_LOG_MAX_STRINGS - strings_length - 1);
+      memcpy(strings + strings_length, str, len);
+      args[argc].str_offs = strings_length;
+      strings_length += len;
+      strings[strings_length++] = '\0';
+      break;
+    }
+    default:
+      /* Unsupported conversion, the drain prints the format verbatim from
+       * here on so nothing after it is captured
+       */
+      argc -= stars;
+      unsupported = true;
+      break;
+    }
+
+    if (unsupported)
+      break;
+
+    argc++;
+  }
+
+  size_t record_length = sizeof(log_record_t) + argc * sizeof(log_arg_t) +
+                         strings_length;
+  record_length = (record_length + 7) & ~(size_t)7;
+
+  log_ring_t *ring = log_thread_ring;
+  if (ring == NULL)
+    return 0;
+
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t offs = head % MAWIM_LOG_RING_SIZE;
+
+  /* Records do not wrap, skip the rest of the buffer if needed */
+  size_t skip = MAWIM_LOG_RING_SIZE - offs < record_length
+                    ? MAWIM_LOG_RING_SIZE - offs
+                    : 0;
+
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (_log_free_space(head, tail) < skip + record_length) {
+    /* Only the main thread writes out, the others must not block on I/O */
+    if (ring != &log_rings[0]) {
+      atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+      return 0;
+    }
+
+    /* Full, make room by writing out everything queued so far */
+    mawim_log_drain();
+  }
+
+  if (skip > 0) {
+    if (skip >= sizeof(log_record_t))
+      ((log_record_t *)(ring->buffer + offs))->format = NULL;
+    head += skip;
+    offs = 0;
+  }
+
+  log_record_t *record = (log_record_t *)(ring->buffer + offs);
+  record->length = record_length;
+  record->level = level;
+  record->noprefix = noprefix;
+  record->argc = argc;
+  record->format = format;
 
+  uint8_t *payload = ring->buffer + offs + sizeof(log_record_t);
+  memcpy(payload, args, argc * sizeof(log_arg_t));
+  memcpy(payload + argc * sizeof(log_arg_t), strings, strings_length);
+
+  atomic_store_explicit(&ring->head, head + record_length,
+                        memory_order_release);
+
+  return record_length;
+}
+
+int _mawim_logf(log_level_t level, const char *format, ...) {
   va_list arg;
   int done;
 
   va_start(arg, format);
-  done = vfprintf(stderr, format, arg);
+  done = _log_queue(level, false, format, arg);
   va_end(arg);
 
-  fprintf(stderr, ANSI_RESET);
-
   return done;
 }
 
-int mawim_logf_noprefix(log_level_t level, const char *format, ...) {
-  if (level < mawim_log_level)
-    return 0;
-
+int _mawim_logf_noprefix(log_level_t level, const char *format, ...) {
   va_list arg;
   int done;
 
   va_start(arg, format);
-  done = vfprintf(stderr, format, arg);
+  done = _log_queue(level, true, format, arg);
   va_end(arg);
 
   return done;
 }
 
-void mawim_log(int level, char *msg) { mawim_logf(level, msg, ""); }
+/* record formatting */
+
+typedef struct log_output {
+  char   buffer[MAWIM_LOG_OUTPUT_BUFFER_SIZE];
+  size_t length;
+} log_output_t;
+
+void _log_write_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written == -1) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+
+    data += written;
+    length -= written;
+  }
+}
+
+void _log_rotate(void) {
+  size_t path_length = strlen(log_file_path);
+  char rotated[path_length + 3];
+  memcpy(rotated, log_file_path, path_length);
+  memcpy(rotated + path_length, ".1", 3);
+
+  close(log_file_fd);
+  rename(log_file_path, rotated);
+
+  log_file_fd =
+      open(log_file_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  log_file_size = 0;
+}
+
+void _log_flush(log_output_t *out, int fd) {
+  if (out->length == 0)
+    return;
+
+  _log_write_all(fd, out->buffer, out->length);
+
+  if (fd == log_file_fd) {
+    log_file_size += out->length;
+    if (log_file_max_size > 0 && log_file_size >= log_file_max_size)
+      _log_rotate();
+  }
+
+  out->length = 0;
+}
+
+void _log_append(log_output_t *out, int fd, const char *str, size_t length) {
+  if (out->length + length > sizeof(out->buffer))
+    _log_flush(out, fd);
+
+  if (length > sizeof(out->buffer)) {
+    _log_write_all(fd, str, length);
+    return;
+  }
+
+  memcpy(out->buffer + out->length, str, length);
+  out->length += length;
+}
+
+/* Formats a single conversion, spec_start points at the '%' */
+int _log_format_arg(char *dest, size_t size, const char *spec_start,
+                    const char *spec_end, int stars, char length,
+                    log_arg_t *args, const char *strings) {
+  /* Rebuild the spec without length modifier, integers are formatted as long
+   * long since that is how they were captured.
+   */
+  char spec[32];
+  size_t spec_length = spec_end - spec_start;
+  if (length != '\0')
+    spec_length -= (length == 'H' || length == 'q') ? 2 : 1;
+
+  if (spec_length + 3 > sizeof(spec))
+    return 0;
+
+  memcpy(spec, spec_start, spec_length);
+
+  char conversion = *spec_end;
+  size_t ix = spec_length;
+  if (strchr("diuxXo", conversion) != NULL) {
+    spec[ix++] = 'l';
+    spec[ix++] = 'l';
+  }
+  spec[ix++] = conversion;
+  spec[ix] = '\0';
+
+  int w = stars > 0 ? (int)args[0].i : 0;
+  int p = stars > 1 ? (int)args[1].i : 0;
+  log_arg_t value = args[stars];
+
+#define FORMAT_WITH(v)                                                         \
+  (stars == 0   ? snprintf(dest, size, spec, v)                                \
+   : stars == 1 ? snprintf(dest, size, spec, w, v)                             \
+                : snprintf(dest, size, spec, w, p, v))
+
+  switch (conversion) {
+  case 'd':
+  case 'i':
+    return FORMAT_WITH(value.i);
+  case 'c':
+    return FORMAT_WITH((int)value.i);
+  case 'u':
+  case 'x':
+  case 'X':
+  case 'o':
+    return FORMAT_WITH(value.u);
+  case 'p':
+    return FORMAT_WITH(value.p);
+  case 's':
+    return FORMAT_WITH(strings + value.str_offs);
+  default:
+    return FORMAT_WITH(value.f);
+  }
+
+#undef FORMAT_WITH
+}
+
+void _log_format_record(log_record_t *record, log_output_t *out, int fd,
+                        bool ansi) {
+  log_arg_t *args = (log_arg_t *)((uint8_t *)record + sizeof(log_record_t));
+  const char *strings = (const char *)(args + record->argc);
+
+  if (!record->noprefix) {
+    const char *level_prefix;
+    switch (record->level) {
+    default:
+    case LOG_DEBUG:
+      level_prefix = ansi ? ANSI_BOLD ANSI_FG_CYAN "DBG" ANSI_RESET " " ANSI_BOLD
+                          : "DBG ";
+      break;
+    case LOG_INFO:
+      level_prefix = ansi ? ANSI_BOLD ANSI_FG_GREEN "INF" ANSI_RESET
+                                                    " " ANSI_BOLD
+                          : "INF ";
+      break;
+    case LOG_WARNING:
+      level_prefix = ansi ? ANSI_BOLD ANSI_FG_YELLOW "WRN" ANSI_RESET
+                                                     " " ANSI_BOLD
+                          : "WRN ";
+      break;
+    case LOG_ERROR:
+      level_prefix = ansi ? ANSI_BOLD ANSI_FG_RED "ERR" ANSI_RESET " " ANSI_BOLD
+                          : "ERR ";
+      break;
+    }
+
+    _log_append(out, fd, level_prefix, strlen(level_prefix));
+  }
+
+  const char *c = record->format;
+  int argi = 0;
+  char formatted[MAWIM_LOG_MAX_STRINGS + 64];
+
+  while (*c != '\0') {
+    const char *literal = c;
+    while (*c != '\0' && *c != '%')
+      c++;
+    _log_append(out, fd, literal, c - literal);
+
+    if (*c == '\0')
+      break;
+
+    if (c[1] == '%') {
+      _log_append(out, fd, "%", 1);
+      c += 2;
+      continue;
+    }
+
+    int stars;
+    char length;
+    const char *spec_end = _log_parse_spec(c + 1, &stars, &length);
+    if (strchr("diucxXofFeEgGaAps", *spec_end) == NULL ||
+        argi + stars >= record->argc) {
+      /* Not captured, print the rest verbatim */
+      _log_append(out, fd, c, strlen(c));
+      break;
+    }
+
+    int written = _log_format_arg(formatted, sizeof(formatted), c, spec_end,
+                                  stars, length, args + argi, strings);
+    if (written > 0) {
+      _log_append(out, fd, formatted,
+                  (size_t)written < sizeof(formatted) ? (size_t)written
+                                                      : sizeof(formatted) - 1);
+    }
+
+    argi += stars + 1;
+    c = spec_end + 1;
+  }
+
+  if (ansi && !record->noprefix)
+    _log_append(out, fd, ANSI_RESET, sizeof(ANSI_RESET) - 1);
+}
+
+bool mawim_log_thread_init(void) {
+  int ix = atomic_fetch_add(&log_rings_used, 1);
+  if (ix >= MAWIM_LOG_THREADS) {
+    atomic_fetch_sub(&log_rings_used, 1);
+    log_thread_ring = NULL;
+    return false;
+  }
+
+  log_thread_ring = &log_rings[ix];
+  return true;
+}
+
+void _log_drain_ring(log_ring_t *ring, log_output_t *out, int fd) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+  while (tail != head) {
+    size_t offs = tail % MAWIM_LOG_RING_SIZE;
+    log_record_t *record = (log_record_t *)(ring->buffer + offs);
+
+    /* Skip marker, the next record starts at the beginning of the buffer */
+    if (MAWIM_LOG_RING_SIZE - offs < sizeof(log_record_t) ||
+        record->format == NULL) {
+      tail += MAWIM_LOG_RING_SIZE - offs;
+      continue;
+    }
+
+    _log_format_record(record, out, fd, log_file_fd == -1);
+    tail += record->length;
+  }
+
+  atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+  unsigned long dropped =
+      atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+  if (dropped > 0) {
+    char notice[64];
+    int length = snprintf(notice, sizeof(notice),
+                          "WRN %lu log records dropped\n", dropped);
+    _log_append(out, fd, notice, length);
+  }
+}
+
+void mawim_log_drain(void) {
+  static log_output_t out;
+
+  pthread_mutex_lock(&log_drain_lock);
+
+  int fd = log_file_fd != -1 ? log_file_fd : STDERR_FILENO;
+
+  /* Records are in order per thread, not across threads */
+  int rings = atomic_load(&log_rings_used);
+  for (int ix = 0; ix < rings && ix < MAWIM_LOG_THREADS; ix++) {
+    _log_drain_ring(&log_rings[ix], &out, fd);
+  }
+
+  _log_flush(&out, fd);
+
+  pthread_mutex_unlock(&log_drain_lock);
+}
+
+bool mawim_log_set_file(const char *path, size_t max_size) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    mawim_logf(LOG_ERROR, "failed to open log file \"%s\": %s\n", path,
+               strerror(errno));
+    return false;
+  }
+
+  mawim_log_drain();
+
+  if (log_file_fd != -1)
+    close(log_file_fd);
+
+  log_file_fd = fd;
+  log_file_path = (char *)path;
+  log_file_size = lseek(fd, 0, SEEK_END);
+  log_file_max_size = max_size;
+
+  return true;
+}
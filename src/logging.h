@@ -8,6 +8,9 @@
 #ifndef LOGGING_H
 #define LOGGING_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 typedef enum log_level {
   LOG_INVALID = -1,
   LOG_DEBUG = 0,
@@ -20,6 +23,39 @@ typedef enum log_level {
 #define DEFAULT_LOG_LEVEL LOG_INFO
 #endif
 
+/* Log calls below this level are compiled out entirely by optimising builds,
+ * neither the call nor its arguments nor the format string end up in the
+ * binary. The runtime log level can not go below it.
+ */
+#if !defined(MAWIM_MIN_LOG_LEVEL)
+#define MAWIM_MIN_LOG_LEVEL LOG_DEBUG
+#endif
+
+/* Size of the buffer queued log records are held in, has to be a multiple of
+ * 8. If it runs full the queued records are written out synchronously.
+ */
+#ifndef MAWIM_LOG_RING_SIZE
+#define MAWIM_LOG_RING_SIZE 65536
+#endif
+
+/* Amount of threads which may log, including the main thread */
+#ifndef MAWIM_LOG_THREADS
+#define MAWIM_LOG_THREADS 2
+#endif
+
+/* Limits for a single record, arguments beyond them are not printed */
+#ifndef MAWIM_LOG_MAX_ARGS
+#define MAWIM_LOG_MAX_ARGS 16
+#endif
+
+#ifndef MAWIM_LOG_MAX_STRINGS
+#define MAWIM_LOG_MAX_STRINGS 1024
+#endif
+
+#ifndef MAWIM_LOG_OUTPUT_BUFFER_SIZE
+#define MAWIM_LOG_OUTPUT_BUFFER_SIZE 8192
+#endif
+
 extern log_level_t mawim_log_level;
 
 /**
@@ -31,28 +67,75 @@ extern log_level_t mawim_log_level;
 log_level_t str_to_loglvl(char *str);
 
 /**
- * @brief Logs a formatted message
+ * @brief Queues a formatted message, use mawim_logf() instead.
+ */
+int _mawim_logf(log_level_t level, const char *format, ...);
+
+/**
+ * @brief Queues a formatted message without prefix, use mawim_logf_noprefix()
+ * instead.
+ */
+int _mawim_logf_noprefix(log_level_t level, const char *format, ...);
+
+/**
+ * @brief Logs a formatted message. The format and its arguments are only
+ * queued, the message is written by the next mawim_log_drain() call. String
+ * arguments are copied, the format string has to outlive the call. The
+ * arguments are only evaluated if the message passes the log level.
  * @param level The logging level
  * @param format The format string
- * @return Upon successful return, the number of characters printed (excluding
- * the null byte used to end output to strings).
  */
-int mawim_logf(log_level_t level, const char *format, ...);
+#define mawim_logf(level, ...)                                                 \
+  do {                                                                         \
+    const log_level_t _log_level = (level);                                    \
+    if (_log_level >= MAWIM_MIN_LOG_LEVEL && _log_level >= mawim_log_level) {  \
+      _mawim_logf(_log_level, __VA_ARGS__);                                    \
+    }                                                                          \
+  } while (0)
 
 /**
- * @brief Logs a formatted message without a prefix
+ * @brief Logs a formatted message without a prefix, see mawim_logf()
  * @param level The logging level
  * @param format The format string
- * @return Upon successful return, the number of characters printed (excluding
- * the null byte used to end output to strings).
  */
-int mawim_logf_noprefix(log_level_t level, const char *format, ...);
+#define mawim_logf_noprefix(level, ...)                                        \
+  do {                                                                         \
+    const log_level_t _log_level = (level);                                    \
+    if (_log_level >= MAWIM_MIN_LOG_LEVEL && _log_level >= mawim_log_level) {  \
+      _mawim_logf_noprefix(_log_level, __VA_ARGS__);                           \
+    }                                                                          \
+  } while (0)
 
 /**
  * @brief Logs a message
  * @param level The logging level
  * @param msg The message
  */
-void mawim_log(int level, char *msg);
+#define mawim_log(level, msg) mawim_logf(level, msg)
+
+/**
+ * @brief Formats and writes out all queued messages. Called by the main loop
+ * before it goes idle.
+ */
+void mawim_log_drain(void);
+
+/**
+ * @brief Gives the calling thread a log ring of its own. Has to be called by
+ * every thread but the main thread before it logs. Records of such threads
+ * are written by the main thread's mawim_log_drain() calls and dropped while
+ * their ring is full.
+ * @return false if all MAWIM_LOG_THREADS rings are taken, the thread's log
+ * calls are dropped then
+ */
+bool mawim_log_thread_init(void);
+
+/**
+ * @brief Writes messages to the given file instead of stderr. Once the file
+ * reaches max_size bytes it is moved to "<path>.1" and a new file is started.
+ * @param path The path of the log file, has to outlive the logger
+ * @param max_size The size at which the file is rotated, 0 to never rotate
+ * @return true on success
+ */
+bool mawim_log_set_file(const char *path, size_t max_size);
 
 #endif /* #ifndef LOGGING_H */
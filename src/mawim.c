@@ -7,23 +7,31 @@
 
 #include "mawim.h"
 
+#include "bindings.h"
 #include "commands.h"
+#include "config.h"
 #include "error.h"
 #include "events.h"
 #include "logging.h"
+#include "metrics.h"
+#include "record.h"
+#include "state_page.h"
+#include "trace.h"
 #include "types.h"
+#include "window.h"
+#include "window_index.h"
+#include "workspace.h"
 #include "xmem.h"
 
 #include <X11/Xlib.h>
 
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-/* We do this define because otherwise nanosleep(); is not available for us */
-#define __USE_POSIX199309
-#include <time.h>
-
 void mawim_workspace_init(mawim_t *mawim) {
   if (mawim->workspaces == NULL) {
     mawim->workspaces =
@@ -40,12 +48,123 @@ void mawim_workspace_init(mawim_t *mawim) {
     workspace->focused_window = NULL;
     workspace->active_row = 0;
     workspace->row_count = 1;
+    workspace->row_capacity = 0;
+    workspace->rows = NULL;
+    workspace->dirty = false;
   }
 }
 
-void mawim_x11_flush(mawim_t *mawim) { XSync(mawim->display, false); }
+void mawim_apply_config(mawim_t *mawim) {
+  const mawim_config_t *config = &mawim->config;
+
+  mawim->max_cols = config->max_cols;
+  mawim->max_rows = config->max_rows;
+  mawim->workspace_count = config->workspace_count;
+
+  mawim->top_gap = config->top_gap;
+  mawim->bottom_gap = config->bottom_gap;
+  mawim->left_gap = config->left_gap;
+  mawim->right_gap = config->right_gap;
+  mawim->border_width = config->border_width;
+}
+
+int mawim_reload_config(mawim_t *mawim) {
+  uint64_t begin = mawim_metrics_now_ns();
+
+  if (mawim->config_path == NULL) {
+    return MAWIM_CONFIG_MISSING;
+  }
+
+  mawim_config_t next;
+  int result = mawim_config_load(mawim->config_path, &next);
+  if (result != MAWIM_CONFIG_OK) {
+    return result;
+  }
+
+  mawim_config_t *live = &mawim->config;
 
-void mawim_x11_discarding_flush(mawim_t *mawim) { XSync(mawim->display, true); }
+  /* Workspaces are allocated once, changing their count would have to move
+   * windows off removed workspaces
+   */
+  if (next.workspace_count != live->workspace_count) {
+    mawim_log(LOG_WARNING, "workspace_count only changes on restart!\n");
+    next.workspace_count = live->workspace_count;
+  }
+
+  /* Diff section by section against the active configuration */
+  int regrabbed = mawim_regrab_binds(mawim, &next);
+
+  bool reflow =
+      next.max_cols != live->max_cols || next.max_rows != live->max_rows;
+  bool rewidth = next.border_width != live->border_width;
+  bool relayout = reflow || rewidth || next.top_gap != live->top_gap ||
+                  next.bottom_gap != live->bottom_gap ||
+                  next.left_gap != live->left_gap ||
+                  next.right_gap != live->right_gap;
+  bool repaint_active = next.active_border_color != live->active_border_color;
+  bool repaint_inactive =
+      next.inactive_border_color != live->inactive_border_color;
+
+  *live = next;
+  mawim_apply_config(mawim);
+
+  if (!relayout && !repaint_active && !repaint_inactive) {
+    mawim_logf(LOG_INFO, "reloaded config in %.3fms, %d grab(s) changed\n",
+               (mawim_metrics_now_ns() - begin) / 1e6, regrabbed);
+    return MAWIM_CONFIG_OK;
+  }
+
+  int repainted = 0;
+  for (mawimctl_workspaceid_t wid = 1; wid <= mawim->workspace_count; wid++) {
+    mawim_workspace_t *workspace = &mawim->workspaces[wid - 1];
+
+    /* The layout is committed at the end of the main loop iteration and only
+     * reconfigures windows whose geometry changed
+     */
+    if (reflow) {
+      mawim_reflow_workspace(mawim, wid);
+    } else if (relayout) {
+      mawim_mark_workspace_dirty(mawim, wid);
+    }
+
+    for (mawim_window_t *window = workspace->windows.first; window != NULL;
+         window = window->next) {
+      if (window->row < 0) {
+        continue;
+      }
+
+      if (rewidth) {
+        XSetWindowBorderWidth(mawim->display, window->x11_window,
+                              mawim->border_width);
+      }
+
+      bool focused = workspace->focused_window == window;
+      if (focused ? repaint_active : repaint_inactive) {
+        mawim_paint_window_border(mawim, window);
+        repainted++;
+      }
+    }
+  }
+
+  mawim_logf(LOG_INFO,
+             "reloaded config in %.3fms, %d grab(s) changed, %d border(s) "
+             "repainted%s\n",
+             (mawim_metrics_now_ns() - begin) / 1e6, regrabbed, repainted,
+             relayout ? ", relayout queued" : "");
+  return MAWIM_CONFIG_OK;
+}
+
+void mawim_x11_flush(mawim_t *mawim) {
+  uint64_t trace_begin = mawim_trace_begin();
+  XSync(mawim->display, false);
+  mawim_trace_end("XSync", trace_begin);
+  mawim_metrics.x_round_trips++;
+}
+
+void mawim_x11_discarding_flush(mawim_t *mawim) {
+  XSync(mawim->display, true);
+  mawim_metrics.x_round_trips++;
+}
 
 void mawim_x11_init(mawim_t *mawim) {
   mawim->display = XOpenDisplay(XNULL);
@@ -75,9 +194,41 @@ void mawim_x11_init(mawim_t *mawim) {
   mawim_x11_flush(mawim);
 }
 
+void mawim_wait_for_events(mawim_t *mawim) {
+  /* Hand everything queued for mawimctl clients to the I/O thread */
+  mawimctl_server_flush(mawim->mawimctl);
+
+  /* Anything already read into Xlib's queue would not wake up poll() */
+  if (XPending(mawim->display) > 0) {
+    return;
+  }
+
+  /* The X11 connection and the eventfd the mawimctl I/O thread signals once it
+   * handed over commands
+   */
+  struct pollfd fds[2] = {
+      {.fd = ConnectionNumber(mawim->display), .events = POLLIN},
+      {.fd = mawim->mawimctl->main_wake_fd, .events = POLLIN},
+  };
+
+  while (poll(fds, 2, -1) == -1) {
+    if (errno != EINTR) {
+      mawim_logf(LOG_ERROR, "poll failed: %s (OS Error %d)\n",
+                 strerror(errno), errno);
+      return;
+    }
+  }
+}
+
 void mawim_shutdown(mawim_t *mawim) {
+  mawim_state_page_close();
+  mawim_window_index_destroy();
+  mawim_geometry_table_free(&mawim->geometry);
   XCloseDisplay(mawim->display);
-  mawimctl_server_stop(mawim->mawimctl);
+
+  if (mawim->mawimctl != NULL) {
+    mawimctl_server_stop(mawim->mawimctl);
+  }
 }
 
 void help() {
@@ -88,12 +239,31 @@ void help() {
   printf("\n");
   printf("v" MAWIM_VERSION "\n");
   printf("\t--help              Show this help text\n");
+  printf("\t--config=<file>     Load the configuration from file\n");
   printf("\t--verbosity=<0..3>  Specifies the log verbosity\n");
+  printf("\t--log-file=<file>   Log to file instead of stderr\n");
+  printf("\t--log-max-size=<n>  Rotate the log file after n bytes\n");
+  printf("\t--trace             Record spans for MAWIMCTL_GET_TRACE\n");
+  printf("\t--record=<file>     Record all events and commands to file\n");
+  printf("\t--replay=<file>     Replay a recording as fast as possible and "
+         "exit\n");
   printf("\n");
 }
 
+char *config_path = NULL;
+char *record_path = NULL;
+char *replay_path = NULL;
+char *log_file_path = NULL;
+size_t log_max_size = 0;
+
 void parse_args(int argc, char **argv) {
+  const char *ARG_CONFIG = "--config=";
   const char *ARG_VERBOSITY = "--verbosity=";
+  const char *ARG_RECORD = "--record=";
+  const char *ARG_REPLAY = "--replay=";
+  const char *ARG_LOG_FILE = "--log-file=";
+  const char *ARG_LOG_MAX_SIZE = "--log-max-size=";
+  const char *ARG_TRACE = "--trace";
   const char *ARG_HELP = "--help";
 
   for (int i = 0; i < argc; i++) {
@@ -103,10 +273,45 @@ void parse_args(int argc, char **argv) {
         wanted = DEFAULT_LOG_LEVEL;
       }
 
+      /* Anything below was compiled out */
+      if (wanted < MAWIM_MIN_LOG_LEVEL) {
+        wanted = MAWIM_MIN_LOG_LEVEL;
+      }
+
       mawim_log_level = wanted;
       continue;
     }
 
+    if (strncmp(argv[i], ARG_CONFIG, strlen(ARG_CONFIG)) == 0) {
+      config_path = argv[i] + strlen(ARG_CONFIG);
+      continue;
+    }
+
+    if (strncmp(argv[i], ARG_RECORD, strlen(ARG_RECORD)) == 0) {
+      record_path = argv[i] + strlen(ARG_RECORD);
+      continue;
+    }
+
+    if (strncmp(argv[i], ARG_REPLAY, strlen(ARG_REPLAY)) == 0) {
+      replay_path = argv[i] + strlen(ARG_REPLAY);
+      continue;
+    }
+
+    if (strncmp(argv[i], ARG_LOG_FILE, strlen(ARG_LOG_FILE)) == 0) {
+      log_file_path = argv[i] + strlen(ARG_LOG_FILE);
+      continue;
+    }
+
+    if (strncmp(argv[i], ARG_LOG_MAX_SIZE, strlen(ARG_LOG_MAX_SIZE)) == 0) {
+      log_max_size = strtoul(argv[i] + strlen(ARG_LOG_MAX_SIZE), NULL, 10);
+      continue;
+    }
+
+    if (strcmp(argv[i], ARG_TRACE) == 0) {
+      mawim_trace_enable();
+      continue;
+    }
+
     if (strncmp(argv[i], ARG_HELP, strlen(ARG_HELP)) == 0) {
       help();
       exit(0);
@@ -119,34 +324,71 @@ int main(int argc, char **argv) {
 
   parse_args(argc, argv);
 
+  if (log_file_path != NULL && !mawim_log_set_file(log_file_path, log_max_size)) {
+    mawim_panic("Failed to open log file!\n");
+  }
+
   mawim_log(LOG_INFO, "Running MaWiM v" MAWIM_VERSION "\n");
 
   mawim_t mawim = {
-      .max_cols = 2,
-      .max_rows = 3,
-      .workspace_count = 2,
+      .running = true,
       .active_workspace = 1,
       .workspaces = NULL,
+      .mawimctl = NULL,
+      .geometry = {.count = 0, .capacity = 0},
   };
 
+  if (config_path == NULL) {
+    config_path = (char *)mawim_config_default_path();
+  }
+
+  int config_result = config_path != NULL
+                          ? mawim_config_load(config_path, &mawim.config)
+                          : MAWIM_CONFIG_MISSING;
+  if (config_result == MAWIM_CONFIG_MISSING) {
+    mawim_config_defaults(&mawim.config);
+    mawim_log(LOG_WARNING, "No configuration found, using the defaults!\n");
+  } else if (config_result == MAWIM_CONFIG_MALFORMED) {
+    mawim_log(LOG_ERROR, "Configuration is malformed, using the defaults!\n");
+  }
+
+  mawim.config_path = config_path;
+  mawim_apply_config(&mawim);
   mawim_workspace_init(&mawim);
 
   mawim_x11_init(&mawim);
 
+  if (replay_path != NULL) {
+    bool replayed = mawim_replay(&mawim, replay_path);
+    mawim_shutdown(&mawim);
+    mawim_log_drain();
+    return replayed ? 0 : 1;
+  }
+
+  if (record_path != NULL && !mawim_record_start(record_path)) {
+    mawim_panic("Failed to start recording!\n");
+  }
+
   mawim.mawimctl = mawimctl_server_start(getenv("MAWIMCTL_SOCK"));
   if (mawim.mawimctl == NULL) {
     mawim_panic("Failed to create mawimctl server!\n");
   }
 
-  struct timespec sleep_time;
-  sleep_time.tv_nsec = 1000 * 1000 * 100;
-  sleep_time.tv_sec = 0;
+  if (!mawim_state_page_open(getenv("MAWIMCTL_STATE_PAGE"))) {
+    mawim_log(LOG_WARNING, "Running without a state page!\n");
+  }
+
+  /* Programs spawned by exec binds are reaped automatically */
+  signal(SIGCHLD, SIG_IGN);
+  mawim_grab_binds(&mawim);
+  mawim_x11_flush(&mawim);
 
   XEvent event;
-  while (true) {
+  while (mawim.running) {
     /* Process X11 Events */
     while (XPending(mawim.display) > 0) {
       XNextEvent(mawim.display, &event);
+      mawim_record_event(&event);
 
       bool handled = mawim_handle_event(&mawim, event);
       if (!handled) {
@@ -162,22 +404,32 @@ int main(int argc, char **argv) {
     while (mawimctl_server_next_command(mawim.mawimctl, &cmd)) {
       mawim_logf(LOG_DEBUG, "Handling mawimctl command %d\n",
                  cmd.command_identifier);
+      mawim_record_command(&cmd);
 
       bool handled = mawim_handle_ctl_command(&mawim, cmd);
       if (!handled) {
         mawim_logf(LOG_WARNING, "got unexpected mawimctl command: %d\n",
                    cmd.command_identifier);
       }
+    }
 
-      if (cmd.data != NULL) {
-        xfree(cmd.data);
-      }
+    /* Lay out everything touched in this iteration in one go */
+    mawim_commit_workspaces(&mawim);
+    mawim_state_page_update(&mawim);
+    mawim_record_iteration();
+    mawim_log_drain();
+
+    /* A quit bind was handled */
+    if (!mawim.running) {
+      break;
     }
 
-    nanosleep(&sleep_time, NULL);
+    mawim_wait_for_events(&mawim);
   }
 
+  mawim_record_stop();
   mawim_shutdown(&mawim);
+  mawim_log_drain();
 
   fprintf(stderr, "MaWiM: Goodbye!\n");
   return 0;
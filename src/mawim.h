@@ -21,6 +21,24 @@
 #define MAWIM_VERSION BASE_VERSION " [" COMMIT_HASH ", debug build]"
 #endif
 
+/**
+ * @brief takes the layout and bordering settings from the configuration into
+ * the mawim instance. Has to be called before mawim_workspace_init().
+ * @param mawim The mawim instance to configure
+ */
+void mawim_apply_config(mawim_t *mawim);
+
+/**
+ * @brief reloads the configuration file and applies only what changed: binds
+ * are regrabbed if their keys changed, the layout is redone if the gaps,
+ * border width or row/column limits changed and borders are repainted if
+ * their color changed
+ * @param mawim The mawim instance to reconfigure
+ * @return MAWIM_CONFIG_OK, MAWIM_CONFIG_MISSING or MAWIM_CONFIG_MALFORMED.
+ * Unless MAWIM_CONFIG_OK the active configuration stays untouched.
+ */
+int mawim_reload_config(mawim_t *mawim);
+
 /**
  * @brief flushes x11 events
  * @param mawim The mawim instance to flush with
@@ -43,6 +61,13 @@ void mawim_x11_discarding_flush(mawim_t *mawim);
  */
 void mawim_x11_init(mawim_t *mawim);
 
+/**
+ * @brief blocks until either the x11 connection or the mawimctl server have
+ * something to be processed
+ * @param mawim The mawim instance to wait on
+ */
+void mawim_wait_for_events(mawim_t *mawim);
+
 /**
  * @brief does the x11 shutdown for mawim
  * @param mawim The mawim instance to shutdown
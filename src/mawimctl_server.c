@@ -6,6 +6,8 @@
  * information.
  */
 
+#define _GNU_SOURCE
+
 #include "mawimctl_server.h"
 
 #include "logging.h"
@@ -14,11 +16,49 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+/* Queued in place of a command which was too short to be parsed */
+#define _MALFORMED_COMMAND 0xff
+
+/* fds[0] is the server socket and fds[1] the I/O thread's eventfd */
+#define _FIRST_CLIENT 2
+
+/* Maximum amount of messages sent to a client with a single sendmmsg() */
+#define _SEND_BATCH_SIZE 64
+
+/* Every command causes at most a subscription, a response and its completion
+ * to be queued, so this is never expected to fill up.
+ */
+#define _OUTBOUND_QUEUE_SIZE (4 * (MAWIMCTL_SERVER_HANDOFF_SIZE))
+
+enum outbound_type {
+  OUTBOUND_RESPONSE,
+  OUTBOUND_SUBSCRIBE,
+  /* The main thread is done with a command, its data may be reused */
+  OUTBOUND_DONE,
+};
+
+/* clang-format off */
+
+typedef struct outbound_message {
+  uint8_t   type;
+  uint8_t   status;       /* The event mask for OUTBOUND_SUBSCRIBE */
+  uint16_t  data_length;
+  int       sockfd;
+  uint8_t  *data;         /* Owned by the message unless borrowed */
+  bool      borrowed;
+} outbound_message_t;
+
+/* clang-format on */
+
 mawimctl_response_t mawimctl_invalid_command_response = {
     .status = MAWIMCTL_INVALID_COMMAND, .data_length = 0, .data = NULL};
 
@@ -40,7 +80,7 @@ void _try_remove_old_sock(char *where) {
   }
 
   /* attempt to connect to the socket */
-  int sock_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  int sock_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
   if (sock_fd == -1) {
     return;
   }
@@ -63,6 +103,22 @@ void _try_remove_old_sock(char *where) {
   }
 }
 
+void *_io_thread_main(void *arg);
+
+void _wake(int eventfd) {
+  uint64_t one = 1;
+  if (write(eventfd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+    mawim_logf(LOG_ERROR, "mawimctl_server: failed to wake thread: %s\n",
+               strerror(errno));
+  }
+}
+
+void _clear_wake(int eventfd) {
+  uint64_t count;
+  while (read(eventfd, &count, sizeof(count)) == -1 && errno == EINTR)
+    ;
+}
+
 mawimctl_server_t *mawimctl_server_start(char *where) {
   char *errstr;
 
@@ -74,11 +130,21 @@ mawimctl_server_t *mawimctl_server_start(char *where) {
 
   mawimctl_server_t *server = xmalloc(sizeof(mawimctl_server_t));
   server->sock_path = where;
-  server->pending_cmd_count = 0;
-  server->pending_cmds = NULL;
+  server->fd_count = 0;
+  server->fd_capacity = 0;
+  server->fds = NULL;
+  server->queues = NULL;
+  server->next_client = _FIRST_CLIENT;
+  server->handling = false;
+  server->handling_fd = -1;
+  server->io_wake_pending = false;
+  atomic_init(&server->running, false);
+  atomic_init(&server->pending_cmd_count, 0);
+  atomic_init(&server->pending_cmd_peak, 0);
+  atomic_init(&server->subscriber_count, 0);
 
   /* Initialise Socket */
-  server->sock_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  server->sock_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
   if (server->sock_fd == -1) {
     errstr = strerror(errno);
     mawim_logf(LOG_ERROR,
@@ -122,125 +188,382 @@ mawimctl_server_t *mawimctl_server_start(char *where) {
     return NULL;
   }
 
+  server->main_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  server->io_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (server->main_wake_fd == -1 || server->io_wake_fd == -1) {
+    errstr = strerror(errno);
+    mawim_logf(LOG_ERROR,
+               "mawimctl_server: error creating eventfd: %s (OS Error %d)\n",
+               errstr, errno);
+    xfree(server);
+    return NULL;
+  }
+
+  mawim_spsc_init(&server->commands, MAWIMCTL_SERVER_HANDOFF_SIZE,
+                  sizeof(mawimctl_command_t));
+  mawim_spsc_init(&server->outbound, _OUTBOUND_QUEUE_SIZE,
+                  sizeof(outbound_message_t));
+  mawim_spsc_init(&server->events, MAWIMCTL_SERVER_EVENT_QUEUE_SIZE,
+                  sizeof(mawimctl_event_t));
+
+  server->fd_capacity = 8;
+  server->fds = xmalloc(server->fd_capacity * sizeof(*server->fds));
+  server->queues = xmalloc(server->fd_capacity * sizeof(*server->queues));
+  server->fds[0].fd = server->sock_fd;
+  server->fds[0].events = POLLIN;
+  server->fds[0].revents = 0;
+  server->fds[1].fd = server->io_wake_fd;
+  server->fds[1].events = POLLIN;
+  server->fds[1].revents = 0;
+  server->fd_count = _FIRST_CLIENT;
+
+  atomic_store(&server->running, true);
+  ret = pthread_create(&server->io_thread, NULL, _io_thread_main, server);
+  if (ret != 0) {
+    mawim_logf(LOG_ERROR,
+               "mawimctl_server: error starting I/O thread: %s "
+               "(OS Error %d)\n",
+               strerror(ret), ret);
+    mawim_spsc_free(&server->commands);
+    mawim_spsc_free(&server->outbound);
+    mawim_spsc_free(&server->events);
+    xfree(server->fds);
+    xfree(server->queues);
+    xfree(server);
+    return NULL;
+  }
+
   return server;
 }
 
 void mawimctl_server_stop(mawimctl_server_t *server) {
-  for (int i = 0; i < server->pending_cmd_count; i++) {
-    close(server->pending_cmds[i].sender_fd);
+  atomic_store(&server->running, false);
+  _wake(server->io_wake_fd);
+  pthread_join(server->io_thread, NULL);
+
+  for (int ix = _FIRST_CLIENT; ix < server->fd_count; ix++) {
+    mawimctl_command_queue_t *queue = &server->queues[ix];
+    close(queue->fd);
+
+    if (queue->commands != NULL) {
+      xfree(queue->commands);
+    }
+
+    if (queue->recv_buffer != NULL) {
+      xfree(queue->recv_buffer);
+    }
+
+    if (queue->send_buffer != NULL) {
+      xfree(queue->send_buffer);
+    }
   }
 
-  xfree(server->pending_cmds);
+  outbound_message_t message;
+  while (mawim_spsc_pop(&server->outbound, &message)) {
+    if (message.data != NULL && !message.borrowed) {
+      xfree(message.data);
+    }
+  }
+
+  mawim_spsc_free(&server->commands);
+  mawim_spsc_free(&server->outbound);
+  mawim_spsc_free(&server->events);
+
+  xfree(server->fds);
+  xfree(server->queues);
 
+  close(server->main_wake_fd);
+  close(server->io_wake_fd);
   close(server->sock_fd);
 
   xfree(server);
   mawim_log(LOG_INFO, "mawimctl_server: stopped.\n");
 }
 
-mawimctl_command_t _parse_command(uint8_t *raw_buffer, int buffer_size) {
+/* I/O thread */
+
+/**
+ * @brief Parses a received command in place, the data is not copied.
+ * @param header The first 4 bytes of the command
+ * @param payload The data following the header
+ * @param payload_size The amount of bytes received after the header
+ */
+mawimctl_command_t _parse_command(uint8_t *header, uint8_t *payload,
+                                  int payload_size) {
   mawimctl_command_t command;
 
   int cpy_offs = 0;
 
-  memcpy(&command.command_identifier, raw_buffer,
+  memcpy(&command.command_identifier, header,
          sizeof(command.command_identifier));
   cpy_offs += sizeof(command.command_identifier);
 
-  memcpy(&command.flags, raw_buffer + cpy_offs, sizeof(command.flags));
+  memcpy(&command.flags, header + cpy_offs, sizeof(command.flags));
   cpy_offs += sizeof(command.flags);
 
-  memcpy(&command.data_length, raw_buffer + cpy_offs,
-         sizeof(command.data_length));
-  cpy_offs += sizeof(command.data_length);
+  memcpy(&command.data_length, header + cpy_offs, sizeof(command.data_length));
 
-  int to_copy = (buffer_size - MAWIMCTL_COMMAND_BASESIZE) != command.data_length
-                    ? (buffer_size - MAWIMCTL_COMMAND_BASESIZE)
-                    : command.data_length;
-
-  if (to_copy > 0) {
-    command.data = xmalloc(to_copy);
-    memcpy(command.data, raw_buffer + cpy_offs, to_copy);
-  } else {
-    command.data = NULL;
+  /* The data is followed by one padding byte on the wire */
+  int available = payload_size - 1;
+  if (command.data_length > available) {
+    command.data_length = available > 0 ? available : 0;
   }
 
+  command.data = available > 0 ? payload : NULL;
+
   return command;
 }
 
-void _queue_command(mawimctl_server_t *server, mawimctl_command_t command) {
-  if (server->pending_cmd_count == 0) {
-    if (server->pending_cmds != NULL) {
-      xfree(server->pending_cmds);
+void _queue_command(mawimctl_server_t *server, int ix,
+                    mawimctl_command_t command) {
+  mawimctl_command_queue_t *queue = &server->queues[ix];
+
+  if (queue->count == queue->capacity) {
+    /* Unroll the ring into the front of the grown buffer */
+    int new_capacity = queue->capacity == 0 ? 8 : queue->capacity * 2;
+    mawimctl_command_t *commands =
+        xmalloc(new_capacity * sizeof(*queue->commands));
+
+    for (int cix = 0; cix < queue->count; cix++) {
+      commands[cix] =
+          queue->commands[(queue->head + cix) & (queue->capacity - 1)];
     }
 
-    server->pending_cmds = xmalloc(sizeof(command));
-  } else {
-    server->pending_cmds =
-        xrealloc(server->pending_cmds,
-                 sizeof(command) * (server->pending_cmd_count + 1));
+    if (queue->commands != NULL) {
+      xfree(queue->commands);
+    }
+
+    queue->commands = commands;
+    queue->capacity = new_capacity;
+    queue->head = 0;
   }
 
-  server->pending_cmds[server->pending_cmd_count] = command;
-  server->pending_cmd_count++;
+  queue->commands[(queue->head + queue->count) & (queue->capacity - 1)] =
+      command;
+  queue->count++;
+
+  int pending = atomic_fetch_add(&server->pending_cmd_count, 1) + 1;
+  if (pending > atomic_load(&server->pending_cmd_peak)) {
+    atomic_store(&server->pending_cmd_peak, pending);
+  }
 }
 
-void _handle_incoming_command(mawimctl_server_t *server, int fd) {
-  if (server == NULL) {
+int _find_client(mawimctl_server_t *server, int fd) {
+  for (int ix = _FIRST_CLIENT; ix < server->fd_count; ix++) {
+    if (server->queues[ix].fd == fd) {
+      return ix;
+    }
+  }
+
+  return -1;
+}
+
+void _add_client(mawimctl_server_t *server, int fd) {
+  if (server->fd_count - _FIRST_CLIENT >= MAWIMCTL_SERVER_MAX_CLIENTS) {
+    mawim_log(LOG_WARNING, "mawimctl_server: too many clients, refusing!\n");
+    close(fd);
     return;
   }
 
-  /* Receive */
-  uint8_t recvbuf[MAWIMCTL_COMMAND_MAXSIZE];
-  int bytes_read = read(fd, recvbuf, sizeof(recvbuf));
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  if (server->fd_count == server->fd_capacity) {
+    server->fd_capacity *= 2;
+    server->fds =
+        xrealloc(server->fds, server->fd_capacity * sizeof(*server->fds));
+    server->queues = xrealloc(server->queues,
+                              server->fd_capacity * sizeof(*server->queues));
+  }
+
+  server->fds[server->fd_count].fd = fd;
+  server->fds[server->fd_count].events = POLLIN;
+  server->fds[server->fd_count].revents = 0;
+
+  mawimctl_command_queue_t *queue = &server->queues[server->fd_count];
+  queue->fd = fd;
+  queue->head = 0;
+  queue->count = 0;
+  queue->capacity = 0;
+  queue->commands = NULL;
+  queue->in_flight = 0;
+  queue->recv_buffer = NULL;
+  queue->recv_used = 0;
+  queue->send_buffer = NULL;
+  queue->send_offs = 0;
+  queue->send_used = 0;
+  queue->send_capacity = 0;
+  queue->closing = false;
+  queue->subscriptions = 0;
+
+  server->fd_count++;
+}
+
+void _remove_client(mawimctl_server_t *server, int ix) {
+  close(server->queues[ix].fd);
+
+  if (server->queues[ix].commands != NULL) {
+    xfree(server->queues[ix].commands);
+  }
+
+  if (server->queues[ix].recv_buffer != NULL) {
+    xfree(server->queues[ix].recv_buffer);
+  }
+
+  if (server->queues[ix].send_buffer != NULL) {
+    xfree(server->queues[ix].send_buffer);
+  }
+
+  server->fd_count--;
+  server->fds[ix] = server->fds[server->fd_count];
+  server->queues[ix] = server->queues[server->fd_count];
+
+  mawim_log(LOG_DEBUG, "mawimctl_server: client disconnected\n");
+}
+
+/**
+ * @brief Polls a client for reading while its receive buffer has room and for
+ * writing while its send buffer is not empty.
+ */
+void _update_poll(mawimctl_server_t *server, int ix) {
+  mawimctl_command_queue_t *queue = &server->queues[ix];
+
+  size_t recv_free = MAWIMCTL_SERVER_RECV_BUFFER_SIZE - queue->recv_used;
+  bool readable = !queue->closing && recv_free >= MAWIMCTL_COMMAND_MAXSIZE;
+  bool writable = !queue->closing && queue->send_used > queue->send_offs;
+
+  server->fds[ix].fd = readable || writable ? queue->fd : -1;
+  server->fds[ix].events = (readable ? POLLIN : 0) | (writable ? POLLOUT : 0);
+}
+
+/**
+ * @brief Reuses the receive buffer of a client once none of its commands are
+ * referenced anymore. Removes clients which disconnected at that point.
+ * @return true if the client was removed
+ */
+bool _try_release_client(mawimctl_server_t *server, int ix) {
+  mawimctl_command_queue_t *queue = &server->queues[ix];
+  if (queue->count > 0 || queue->in_flight > 0) {
+    return false;
+  }
+
+  if (queue->closing) {
+    _remove_client(server, ix);
+    return true;
+  }
+
+  queue->recv_used = 0;
+  _update_poll(server, ix);
+  return false;
+}
+
+void _disconnect_client(mawimctl_server_t *server, int ix) {
+  mawimctl_command_queue_t *queue = &server->queues[ix];
+
+  queue->closing = true;
+  queue->send_offs = 0;
+  queue->send_used = 0;
+  _update_poll(server, ix);
+
+  if (queue->subscriptions != 0) {
+    queue->subscriptions = 0;
+    atomic_fetch_sub(&server->subscriber_count, 1);
+  }
+
+  /* The commands still queued or in flight are handled without a response.
+   * The fd stays open until they are, so its number is not reused by another
+   * client meanwhile.
+   */
+  _try_release_client(server, ix);
+}
+
+/**
+ * @brief Reads and queues one command from a client.
+ * @return false if the client is done, either because there is nothing left
+ * to read or because it disconnected, see disconnected
+ */
+bool _handle_incoming_command(mawimctl_server_t *server, int ix,
+                              bool *disconnected) {
+  mawimctl_command_queue_t *queue = &server->queues[ix];
+  int fd = queue->fd;
+
+  if (queue->recv_buffer == NULL) {
+    queue->recv_buffer = xmalloc(MAWIMCTL_SERVER_RECV_BUFFER_SIZE);
+  }
+
+  /* Queued commands point into the buffer, so it can not grow. Whatever does
+   * not fit stays in the socket, the client is not read from until all of its
+   * commands were handled.
+   */
+  if (MAWIMCTL_SERVER_RECV_BUFFER_SIZE - queue->recv_used <
+      MAWIMCTL_COMMAND_MAXSIZE) {
+    _update_poll(server, ix);
+    return false;
+  }
+
+  /* Receive the header and the data straight into place */
+  uint8_t header[MAWIMCTL_COMMAND_BASESIZE - 1];
+  uint8_t *payload = queue->recv_buffer + queue->recv_used;
+
+  struct iovec iov[2] = {
+      {.iov_base = header, .iov_len = sizeof(header)},
+      {.iov_base = payload,
+       .iov_len = MAWIMCTL_SERVER_RECV_BUFFER_SIZE - queue->recv_used},
+  };
+  struct msghdr msg = {.msg_iov = iov, .msg_iovlen = 2};
+
+  int bytes_read = recvmsg(fd, &msg, 0);
 
   if (bytes_read == -1) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return false;
+    }
+
     mawim_log(LOG_ERROR, "mawimctl_server: failed to read command!\n");
-    close(fd);
-    return;
+    *disconnected = true;
+    return false;
+  }
+
+  if (bytes_read == 0) {
+    *disconnected = true;
+    return false;
   }
 
   mawim_logf(LOG_DEBUG, "mawimctl_server: read %d bytes\n", bytes_read);
 
+  /* Invalid commands are queued as well and answered in turn, so responses
+   * to pipelined commands always arrive in order.
+   */
   if (bytes_read < MAWIMCTL_COMMAND_BASESIZE) {
     mawim_log(LOG_ERROR, "mawimctl_server: received invalid data format!\n");
-    if (!mawimctl_server_respond(server, fd,
-                                 mawimctl_invalid_data_format_response)) {
-      mawim_log(LOG_ERROR, "mawimctl_server: failed to send response!\n");
-    }
-    close(fd);
-    return;
+    mawimctl_command_t malformed = {.sender_fd = fd,
+                                    .command_identifier = _MALFORMED_COMMAND,
+                                    .flags = 0,
+                                    .data_length = 0,
+                                    .data = NULL};
+    _queue_command(server, ix, malformed);
+    return true;
   }
 
-  mawimctl_command_t command = _parse_command(recvbuf, bytes_read);
+  int payload_size = bytes_read - sizeof(header);
+  mawimctl_command_t command = _parse_command(header, payload, payload_size);
   command.sender_fd = fd;
 
-  /* Handle invalid command */
   if (command.command_identifier >= MAWIMCTL_CMD_INVALID) {
     mawim_log(LOG_ERROR, "mawimctl_server: received invalid command!\n");
-    if (!mawimctl_server_respond(server, fd,
-                                 mawimctl_invalid_command_response)) {
-      mawim_log(LOG_ERROR, "mawimctl_server: failed to send response!\n");
-    }
-    close(fd);
-
-    if (command.data != NULL) {
-      xfree(command.data);
-    }
-
-    return;
+    command.data = NULL;
+    command.data_length = 0;
+    _queue_command(server, ix, command);
+    return true;
   }
 
-  _queue_command(server, command);
+  queue->recv_used += payload_size;
+  _queue_command(server, ix, command);
+  return true;
 }
 
-void mawimctl_server_update(mawimctl_server_t *server) {
-  if (server == NULL) {
-    return;
-  }
-
+void _accept_clients(mawimctl_server_t *server) {
   while (true) {
-    int newfd = accept(server->sock_fd, NULL, NULL);
+    int newfd = accept4(server->sock_fd, NULL, NULL, SOCK_CLOEXEC);
     if (newfd == -1) {
       if (errno == EAGAIN || errno == EWOULDBLOCK) {
         break;
@@ -255,67 +578,468 @@ void mawimctl_server_update(mawimctl_server_t *server) {
     }
 
     mawim_log(LOG_DEBUG, "mawimctl_server: accepted 1 connection\n");
-    _handle_incoming_command(server, newfd);
+    _add_client(server, newfd);
+  }
+}
+
+/**
+ * @brief Appends a message to the send buffer of a client.
+ * @return false if the client fell too far behind
+ */
+bool _buffer_message(mawimctl_command_queue_t *queue, uint8_t status,
+                     const uint8_t *data, uint16_t data_length) {
+  size_t length = MAWIMCTL_RESPONSE_BASESIZE + data_length;
+  size_t pending = queue->send_used - queue->send_offs;
+  if (pending + length > MAWIMCTL_SERVER_SEND_BUFFER_MAX) {
+    return false;
+  }
+
+  if (queue->send_used + length > queue->send_capacity) {
+    /* Move what is left to the front before growing */
+    if (queue->send_offs > 0) {
+      memmove(queue->send_buffer, queue->send_buffer + queue->send_offs,
+              pending);
+      queue->send_offs = 0;
+      queue->send_used = pending;
+    }
+
+    if (queue->send_used + length > queue->send_capacity) {
+      size_t new_capacity = queue->send_capacity == 0
+                                ? MAWIMCTL_RESPONSE_MAXSIZE
+                                : queue->send_capacity * 2;
+      while (new_capacity < queue->send_used + length) {
+        new_capacity *= 2;
+      }
+
+      queue->send_buffer = xrealloc(queue->send_buffer, new_capacity);
+      queue->send_capacity = new_capacity;
+    }
   }
+
+  uint8_t *dest = queue->send_buffer + queue->send_used;
+  memcpy(dest, &status, sizeof(status));
+  memcpy(dest + sizeof(status), &data_length, sizeof(data_length));
+  if (data_length > 0) {
+    memcpy(dest + MAWIMCTL_RESPONSE_BASESIZE, data, data_length);
+  }
+
+  queue->send_used += length;
+  return true;
+}
+
+/**
+ * @brief Sends as many buffered messages to a client as it can take, up to
+ * _SEND_BATCH_SIZE messages per system call.
+ * @return false if the client failed
+ */
+bool _flush_client(mawimctl_server_t *server, int ix) {
+  mawimctl_command_queue_t *queue = &server->queues[ix];
+
+  while (queue->send_offs < queue->send_used) {
+    struct mmsghdr msgs[_SEND_BATCH_SIZE];
+    struct iovec iovs[_SEND_BATCH_SIZE];
+    int count = 0;
+
+    /* Each message is sent on its own, clients rely on the boundaries */
+    size_t offs = queue->send_offs;
+    while (count < _SEND_BATCH_SIZE && offs < queue->send_used) {
+      uint16_t data_length;
+      memcpy(&data_length, queue->send_buffer + offs + 1, sizeof(data_length));
+
+      iovs[count].iov_base = queue->send_buffer + offs;
+      iovs[count].iov_len = MAWIMCTL_RESPONSE_BASESIZE + data_length;
+      memset(&msgs[count], 0, sizeof(msgs[count]));
+      msgs[count].msg_hdr.msg_iov = &iovs[count];
+      msgs[count].msg_hdr.msg_iovlen = 1;
+
+      offs += iovs[count].iov_len;
+      count++;
+    }
+
+    /* A client which disconnected early must not take MaWiM down by SIGPIPE */
+    int sent = sendmmsg(queue->fd, msgs, count, MSG_NOSIGNAL);
+    if (sent == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+
+      char *errstr = strerror(errno);
+      mawim_logf(LOG_ERROR, "mawimctl_server: %s (OS Error %d)\n", errstr,
+                 errno);
+      return false;
+    }
+
+    for (int mix = 0; mix < sent; mix++) {
+      queue->send_offs += iovs[mix].iov_len;
+    }
+
+    mawim_logf(LOG_DEBUG, "mawimctl_server: sent %d messages to fd %d\n", sent,
+               queue->fd);
+
+    /* The socket is full, continue once it is writable again */
+    if (sent < count) {
+      break;
+    }
+  }
+
+  if (queue->send_offs == queue->send_used) {
+    queue->send_offs = 0;
+    queue->send_used = 0;
+  }
+
+  _update_poll(server, ix);
+  return true;
+}
+
+/**
+ * @brief Sends the messages buffered by handling the outbound and event
+ * queues, every client is written to once.
+ */
+void _flush_clients(mawimctl_server_t *server) {
+  for (int ix = server->fd_count - 1; ix >= _FIRST_CLIENT; ix--) {
+    mawimctl_command_queue_t *queue = &server->queues[ix];
+    if (queue->closing || queue->send_used == queue->send_offs) {
+      continue;
+    }
+
+    /* Going backwards the entry swapped in was already looked at */
+    if (!_flush_client(server, ix)) {
+      _disconnect_client(server, ix);
+    }
+  }
+}
+
+void _service_clients(mawimctl_server_t *server) {
+  for (int ix = server->fd_count - 1; ix >= _FIRST_CLIENT; ix--) {
+    struct pollfd *client = &server->fds[ix];
+    if (client->revents == 0) {
+      continue;
+    }
+
+    short revents = client->revents;
+    client->revents = 0;
+
+    bool disconnected = (revents & (POLLERR | POLLNVAL)) != 0;
+    if (!disconnected && (revents & POLLOUT)) {
+      disconnected = !_flush_client(server, ix);
+    }
+
+    if (!disconnected && (client->events & POLLIN) &&
+        (revents & (POLLIN | POLLHUP))) {
+      while (_handle_incoming_command(server, ix, &disconnected))
+        ;
+    }
+
+    /* Going backwards the entry swapped in was already looked at */
+    if (disconnected) {
+      _disconnect_client(server, ix);
+    }
+  }
+}
+
+/**
+ * @brief Moves queued commands to the main thread, one command per client and
+ * turn so a client flooding the server can not starve the others.
+ */
+void _hand_over_commands(mawimctl_server_t *server) {
+  bool handed_over = false;
+
+  int clients = server->fd_count - _FIRST_CLIENT;
+  int idle = 0;
+  while (idle < clients) {
+    if (server->next_client >= server->fd_count) {
+      server->next_client = _FIRST_CLIENT;
+    }
+
+    int ix = server->next_client;
+    mawimctl_command_queue_t *queue = &server->queues[ix];
+    if (queue->count == 0) {
+      server->next_client++;
+      idle++;
+      continue;
+    }
+
+    /* Full, the client keeps its turn */
+    if (!mawim_spsc_push(&server->commands, &queue->commands[queue->head])) {
+      break;
+    }
+
+    queue->head = (queue->head + 1) & (queue->capacity - 1);
+    queue->count--;
+    queue->in_flight++;
+    handed_over = true;
+
+    server->next_client++;
+    idle = 0;
+  }
+
+  if (handed_over) {
+    _wake(server->main_wake_fd);
+  }
+}
+
+void _buffer_response(mawimctl_server_t *server, outbound_message_t *message) {
+  int ix = _find_client(server, message->sockfd);
+  if (ix == -1 || server->queues[ix].closing) {
+    mawim_log(LOG_DEBUG, "mawimctl_server: client is gone, not responding\n");
+    return;
+  }
+
+  if (!_buffer_message(&server->queues[ix], message->status, message->data,
+                       message->data_length)) {
+    mawim_logf(LOG_WARNING,
+               "mawimctl_server: fd %d does not read its responses, "
+               "disconnecting\n",
+               message->sockfd);
+    _disconnect_client(server, ix);
+  }
+}
+
+void _set_subscriptions(mawimctl_server_t *server, int sockfd, uint8_t mask) {
+  int ix = _find_client(server, sockfd);
+  if (ix == -1 || server->queues[ix].closing) {
+    return;
+  }
+
+  mawimctl_command_queue_t *queue = &server->queues[ix];
+  if (queue->subscriptions == 0 && mask != 0) {
+    atomic_fetch_add(&server->subscriber_count, 1);
+  } else if (queue->subscriptions != 0 && mask == 0) {
+    atomic_fetch_sub(&server->subscriber_count, 1);
+  }
+
+  queue->subscriptions = mask;
+}
+
+void _finish_command(mawimctl_server_t *server, int sockfd) {
+  int ix = _find_client(server, sockfd);
+  if (ix == -1) {
+    return;
+  }
+
+  server->queues[ix].in_flight--;
+  atomic_fetch_sub(&server->pending_cmd_count, 1);
+  _try_release_client(server, ix);
+}
+
+void _handle_outbound(mawimctl_server_t *server) {
+  outbound_message_t message;
+  while (mawim_spsc_pop(&server->outbound, &message)) {
+    switch (message.type) {
+    case OUTBOUND_RESPONSE:
+      _buffer_response(server, &message);
+      break;
+    case OUTBOUND_SUBSCRIBE:
+      _set_subscriptions(server, message.sockfd, message.status);
+      break;
+    case OUTBOUND_DONE:
+      _finish_command(server, message.sockfd);
+      break;
+    }
+
+    if (message.data != NULL && !message.borrowed) {
+      xfree(message.data);
+    }
+  }
+}
+
+void _handle_events(mawimctl_server_t *server) {
+  mawimctl_event_t event;
+  while (mawim_spsc_pop(&server->events, &event)) {
+    for (int ix = server->fd_count - 1; ix >= _FIRST_CLIENT; ix--) {
+      mawimctl_command_queue_t *queue = &server->queues[ix];
+      if (!(queue->subscriptions & MAWIMCTL_EVENT_MASK(event.type))) {
+        continue;
+      }
+
+      if (!_buffer_message(queue, MAWIMCTL_EVENT, (uint8_t *)&event,
+                           sizeof(event))) {
+        mawim_logf(LOG_WARNING,
+                   "mawimctl_server: subscriber fd %d does not keep up, "
+                   "disconnecting\n",
+                   queue->fd);
+        _disconnect_client(server, ix);
+      }
+    }
+  }
+}
+
+void *_io_thread_main(void *arg) {
+  mawimctl_server_t *server = arg;
+
+  if (!mawim_log_thread_init()) {
+    mawim_log(LOG_ERROR, "mawimctl_server: no log ring left for I/O thread\n");
+  }
+
+  while (atomic_load(&server->running)) {
+    if (poll(server->fds, server->fd_count, -1) == -1) {
+      if (errno != EINTR) {
+        mawim_logf(LOG_ERROR, "mawimctl_server: poll failed: %s\n",
+                   strerror(errno));
+        break;
+      }
+      continue;
+    }
+
+    if (server->fds[1].revents != 0) {
+      _clear_wake(server->io_wake_fd);
+    }
+
+    /* Completions first, they may make room for further commands */
+    _handle_outbound(server);
+    _handle_events(server);
+    _flush_clients(server);
+
+    if (server->fds[0].revents != 0) {
+      _accept_clients(server);
+    }
+
+    _service_clients(server);
+    _hand_over_commands(server);
+  }
+
+  return NULL;
+}
+
+/* main thread */
+
+void _queue_outbound(mawimctl_server_t *server, outbound_message_t message) {
+  while (!mawim_spsc_push(&server->outbound, &message)) {
+    _wake(server->io_wake_fd);
+    sched_yield();
+  }
+
+  server->io_wake_pending = true;
+}
+
+/**
+ * @brief Tells the I/O thread that the command returned last was handled.
+ */
+void _finish_handling(mawimctl_server_t *server) {
+  if (!server->handling) {
+    return;
+  }
+
+  outbound_message_t done = {.type = OUTBOUND_DONE,
+                             .status = 0,
+                             .data_length = 0,
+                             .sockfd = server->handling_fd,
+                             .data = NULL};
+  _queue_outbound(server, done);
+  server->handling = false;
+}
+
+void mawimctl_server_update(mawimctl_server_t *server) {
+  if (server == NULL) {
+    return;
+  }
+
+  _clear_wake(server->main_wake_fd);
 }
 
 bool mawimctl_server_next_command(mawimctl_server_t *server,
                                   mawimctl_command_t *dest_container) {
-  if (server == NULL || server->pending_cmd_count == 0) {
+  if (server == NULL) {
     return false;
   }
 
-  *dest_container = server->pending_cmds[0];
-  server->pending_cmd_count--;
+  _finish_handling(server);
 
-  if (server->pending_cmd_count == 0) {
-    xfree(server->pending_cmds);
-    server->pending_cmds = NULL;
-    return true;
+  while (mawim_spsc_pop(&server->commands, dest_container)) {
+    server->handling = true;
+    server->handling_fd = dest_container->sender_fd;
+
+    if (dest_container->command_identifier < MAWIMCTL_CMD_INVALID) {
+      return true;
+    }
+
+    if (!(dest_container->flags & MAWIMCTL_FLAG_NO_RESPONSE)) {
+      mawimctl_response_t response =
+          dest_container->command_identifier == _MALFORMED_COMMAND
+              ? mawimctl_invalid_data_format_response
+              : mawimctl_invalid_command_response;
+      mawimctl_server_respond(server, dest_container->sender_fd, response);
+    }
+
+    _finish_handling(server);
   }
 
-  /* Move every queued command up 1 slot */
-  for (int wix = 0; wix < server->pending_cmd_count; wix++) {
-    server->pending_cmds[wix] = server->pending_cmds[wix + 1];
+  /* Get the responses out before the layout is committed */
+  mawimctl_server_flush(server);
+  return false;
+}
+
+bool _respond(mawimctl_server_t *server, int sockfd,
+              mawimctl_response_t response, bool borrowed) {
+  if (sockfd < 0) {
+    mawim_log(LOG_DEBUG, "mawimctl_server: client is gone, not responding\n");
+    if (response.data != NULL && !borrowed) {
+      xfree(response.data);
+    }
+    return false;
   }
 
-  server->pending_cmds =
-      xrealloc(server->pending_cmds,
-               sizeof(mawimctl_command_t) * server->pending_cmd_count);
+  uint16_t data_length = response.data != NULL ? response.data_length : 0;
+  outbound_message_t message = {.type = OUTBOUND_RESPONSE,
+                                .status = response.status,
+                                .data_length = data_length,
+                                .sockfd = sockfd,
+                                .data = response.data,
+                                .borrowed = borrowed};
 
+  /* The I/O thread frees owned data once it is in the client's send buffer */
+  _queue_outbound(server, message);
   return true;
 }
 
 bool mawimctl_server_respond(mawimctl_server_t *server, int sockfd,
                              mawimctl_response_t response) {
-  size_t sendbuf_size = MAWIMCTL_RESPONSE_BASESIZE + response.data_length;
-  uint8_t *sendbuf = xmalloc(sendbuf_size);
-  memset(sendbuf, 0, sendbuf_size);
+  return _respond(server, sockfd, response, false);
+}
 
-  /* Copy data to send buffer */
-  int cpyoffs = 0;
+bool mawimctl_server_respond_borrowed(mawimctl_server_t *server, int sockfd,
+                                      mawimctl_response_t response) {
+  return _respond(server, sockfd, response, true);
+}
 
-  memcpy(sendbuf + cpyoffs, &response.status, sizeof(response.status));
-  cpyoffs += sizeof(response.status);
+bool mawimctl_server_subscribe(mawimctl_server_t *server, int sockfd,
+                               uint8_t mask) {
+  if (sockfd < 0) {
+    return false;
+  }
+
+  outbound_message_t message = {.type = OUTBOUND_SUBSCRIBE,
+                                .status = mask,
+                                .data_length = 0,
+                                .sockfd = sockfd,
+                                .data = NULL};
+  _queue_outbound(server, message);
+  return true;
+}
 
-  if (response.data != NULL) {
-    memcpy(sendbuf + cpyoffs, &response.data_length,
-           sizeof(response.data_length));
-    cpyoffs += sizeof(response.data_length);
+void mawimctl_server_publish(mawimctl_server_t *server,
+                             const mawimctl_event_t *event) {
+  if (server == NULL || atomic_load(&server->subscriber_count) == 0) {
+    return;
+  }
 
-    memcpy(sendbuf + cpyoffs, response.data, response.data_length);
+  if (!mawim_spsc_push(&server->events, event)) {
+    mawim_log(LOG_DEBUG, "mawimctl_server: event queue full, dropped event\n");
+    return;
   }
 
-  int ret = write(sockfd, sendbuf, sendbuf_size);
+  server->io_wake_pending = true;
+}
 
-  if (ret == -1) {
-    char *errstr = strerror(errno);
-    mawim_logf(LOG_ERROR, "mawimctl_server: %s (OS Error %d)\n", errstr, errno);
-  } else {
-    mawim_logf(LOG_DEBUG, "mawimctl_server: sent %d out of %d bytes!\n", ret,
-               sendbuf_size);
+void mawimctl_server_flush(mawimctl_server_t *server) {
+  if (server == NULL || !server->io_wake_pending) {
+    return;
   }
 
-  xfree(sendbuf);
-  return true;
+  _wake(server->io_wake_fd);
+  server->io_wake_pending = false;
 }
@@ -10,14 +10,54 @@
 #define MAWIMCTL_SERVER_H
 
 #include "mawimctl.h"
+#include "spsc.h"
 
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <sys/un.h>
 
 #ifndef MAWIMCTL_SERVER_CONNECTION_BACKLOG_SIZE
 #define MAWIMCTL_SERVER_CONNECTION_BACKLOG_SIZE 20
 #endif
 
+/* Maximum amount of clients connected at the same time, further connections
+ * are refused until a client disconnects.
+ */
+#ifndef MAWIMCTL_SERVER_MAX_CLIENTS
+#define MAWIMCTL_SERVER_MAX_CLIENTS 64
+#endif
+
+/* Size of the buffer commands of a client are received into, at least one
+ * command of the maximum size has to fit.
+ */
+#ifndef MAWIMCTL_SERVER_RECV_BUFFER_SIZE
+#define MAWIMCTL_SERVER_RECV_BUFFER_SIZE (2 * (MAWIMCTL_COMMAND_MAXSIZE))
+#endif
+
+/* Maximum amount of response and event data waiting for a client to read it.
+ * Clients which fall further behind are disconnected.
+ */
+#ifndef MAWIMCTL_SERVER_SEND_BUFFER_MAX
+#define MAWIMCTL_SERVER_SEND_BUFFER_MAX (16 * (MAWIMCTL_RESPONSE_MAXSIZE))
+#endif
+
+/* Amount of commands which can be handed to the main thread at once, has to
+ * be a power of 2. Further commands wait in the queue of their client.
+ */
+#ifndef MAWIMCTL_SERVER_HANDOFF_SIZE
+#define MAWIMCTL_SERVER_HANDOFF_SIZE 256
+#endif
+
+/* Amount of events which can wait for the I/O thread, has to be a power of 2.
+ * Events published while it is full are dropped.
+ */
+#ifndef MAWIMCTL_SERVER_EVENT_QUEUE_SIZE
+#define MAWIMCTL_SERVER_EVENT_QUEUE_SIZE 256
+#endif
+
 extern mawimctl_response_t mawimctl_invalid_command_response;
 extern mawimctl_response_t mawimctl_invalid_data_format_response;
 extern mawimctl_response_t mawimctl_no_such_workspace_response;
@@ -27,19 +67,90 @@ extern mawimctl_response_t mawimctl_generic_ok_response;
 
 /* clang-format off */
 
+/* Commands of a single client waiting to be handed to the main thread,
+ * capacity is always a power of 2. Their data points into recv_buffer.
+ */
+typedef struct mawimctl_command_queue {
+  int                 fd;
+
+  int                 head;
+  int                 count;
+  int                 capacity;
+  mawimctl_command_t *commands;
+
+  /* Commands handed to the main thread which it did not finish yet */
+  int                 in_flight;
+
+  uint8_t            *recv_buffer;
+  size_t              recv_used;
+
+  /* Messages not sent yet, starting at send_offs. They are sent whenever the
+   * client is writable.
+   */
+  uint8_t            *send_buffer;
+  size_t              send_offs;
+  size_t              send_used;
+  size_t              send_capacity;
+
+  /* The client disconnected, its fd is closed once nothing is in flight */
+  bool                closing;
+
+  /* MAWIMCTL_EVENT_MASK() of the event types pushed to the client */
+  uint8_t             subscriptions;
+} mawimctl_command_queue_t;
+
+/* All socket I/O happens on a dedicated thread. Commands are passed to the
+ * main thread through a lock-free queue, responses, subscriptions and events
+ * travel back the same way. Each side is woken through an eventfd.
+ */
 typedef struct mawimctl_server {
   char               *sock_path;
   struct sockaddr_un  sock_name;
   int                 sock_fd;
 
-  int                 pending_cmd_count;
-  mawimctl_command_t *pending_cmds;
+  /* Owned by the I/O thread */
+
+  /* fds[0] is the server socket, fds[1] the I/O thread's eventfd, followed by
+   * one entry per client. Clients are polled for POLLOUT while their send
+   * buffer is not empty. The fd of a client which is neither read from,
+   * because its receive buffer is full or it disconnected, nor written to is
+   * -1.
+   */
+  int                 fd_count;
+  int                 fd_capacity;
+  struct pollfd      *fds;
+
+  /* queues[ix] belongs to fds[ix], queues[0] and queues[1] are unused */
+  mawimctl_command_queue_t *queues;
+  int                 next_client;
+
+  pthread_t           io_thread;
+  atomic_bool         running;
+
+  /* Handoff between the threads, main_wake_fd is readable once commands were
+   * handed over.
+   */
+  mawim_spsc_t        commands;     /* I/O thread -> main thread */
+  mawim_spsc_t        outbound;     /* main thread -> I/O thread */
+  mawim_spsc_t        events;       /* main thread -> I/O thread, lossy */
+  int                 main_wake_fd;
+  int                 io_wake_fd;
+
+  /* Owned by the main thread */
+  bool                handling;     /* A command was returned by next_command */
+  int                 handling_fd;
+  bool                io_wake_pending;
+
+  /* Written by the I/O thread, read by the main thread */
+  atomic_int          pending_cmd_count;
+  atomic_int          pending_cmd_peak;
+  atomic_int          subscriber_count;
 } mawimctl_server_t;
 
 /* clang-format on */
 
 /**
- * @brief Starts a mawimctl server
+ * @brief Starts a mawimctl server and its I/O thread
  * @param where The location in the filesystem where the socket should be
  * created. If NULL it will default to MAWIMCTL_DEFAULT_SOCK_LOCATION
  * @return Heap-Allocated server structure, NULL on failure
@@ -47,20 +158,24 @@ typedef struct mawimctl_server {
 mawimctl_server_t *mawimctl_server_start(char *where);
 
 /**
- * @brief Stops a mawimctl server and frees the structure
+ * @brief Stops a mawimctl server, joins its I/O thread and frees the structure
  * @param server The server instance to be stopped
  */
 void mawimctl_server_stop(mawimctl_server_t *server);
 
 /**
- * @brief Updates the server. This includes accepting all new connection
- *        requests, reading their commands an queueing them.
+ * @brief Acknowledges the wakeup through main_wake_fd. Accepting connections
+ *        and reading commands happens on the I/O thread, this only has to be
+ *        called before taking the commands it handed over.
  * @param server The server instance to be updated
  */
 void mawimctl_server_update(mawimctl_server_t *server);
 
 /**
- * @brief Gets the first pending command in the server's queue.
+ * @brief Gets the next command handed over by the I/O thread. Clients are
+ * taken turns with, one command each. The command data is owned by the server
+ * and stays valid until the next mawimctl_server_next_command() call, which
+ * also marks the command as handled.
  * @param server The server instance from which the command should be grabbed
  * @param dest_container Pointer to a mawimctl_command_t structure where the
  * next command should be written to
@@ -70,7 +185,10 @@ bool mawimctl_server_next_command(mawimctl_server_t *server,
                                   mawimctl_command_t *dest_container);
 
 /**
- * @brief Sends a response to the specified client.
+ * @brief Queues a response to the specified client. The I/O thread buffers it
+ * until the client can take it. Takes ownership of response.data, which has to
+ * be NULL or allocated using xmalloc, also if the response could not be
+ * queued.
  * @param server The server to send the response from
  * @param sockfd The socket file descriptor of the client to send it to
  * @param response The response data
@@ -79,4 +197,44 @@ bool mawimctl_server_next_command(mawimctl_server_t *server,
 bool mawimctl_server_respond(mawimctl_server_t *server, int sockfd,
                              mawimctl_response_t response);
 
+/**
+ * @brief Queues a response to the specified client without taking ownership
+ * of response.data. The data has to stay valid and unchanged as long as the
+ * server exists, e.g. constant data.
+ * @param server The server to send the response from
+ * @param sockfd The socket file descriptor of the client to send it to
+ * @param response The response data
+ * @return true on successful response
+ */
+bool mawimctl_server_respond_borrowed(mawimctl_server_t *server, int sockfd,
+                                      mawimctl_response_t response);
+
+/**
+ * @brief Sets the event types which are pushed to a client. Takes effect
+ * before any response queued afterwards is sent.
+ * @param server The server the client is connected to
+ * @param sockfd The socket file descriptor of the client
+ * @param mask MAWIMCTL_EVENT_MASK() of the wanted event types, 0 to unsubscribe
+ * @return false if there is no such client
+ */
+bool mawimctl_server_subscribe(mawimctl_server_t *server, int sockfd,
+                               uint8_t mask);
+
+/**
+ * @brief Pushes an event to every client subscribed to its type. All clients
+ * miss it if the I/O thread falls behind by MAWIMCTL_SERVER_EVENT_QUEUE_SIZE
+ * events.
+ * @param server The server to send the event from
+ * @param event The event
+ */
+void mawimctl_server_publish(mawimctl_server_t *server,
+                             const mawimctl_event_t *event);
+
+/**
+ * @brief Wakes the I/O thread if anything was queued for it since the last
+ * call. Called by the main loop before it goes idle.
+ * @param server The server
+ */
+void mawimctl_server_flush(mawimctl_server_t *server);
+
 #endif /* #ifndef MAWIMCTL_SERVER_H */
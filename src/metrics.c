@@ -0,0 +1,132 @@
+/* metrics.c ; MaWiM runtime performance counters
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "metrics.h"
+
+#include "commands.h"
+#include "events.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+mawimctl_metrics_t mawim_metrics;
+
+uint64_t mawim_metrics_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void mawim_metrics_histogram_add(uint64_t *histogram, uint64_t value) {
+  int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+  if (bucket >= MAWIMCTL_METRICS_HISTOGRAM_BUCKETS) {
+    bucket = MAWIMCTL_METRICS_HISTOGRAM_BUCKETS - 1;
+  }
+
+  histogram[bucket]++;
+}
+
+/* appends to dest, never writing past size */
+void _metrics_appendf(char *dest, size_t size, size_t *offs,
+                      const char *format, ...) {
+  if (*offs >= size) {
+    return;
+  }
+
+  va_list arg;
+  va_start(arg, format);
+  int written = vsnprintf(dest + *offs, size - *offs, format, arg);
+  va_end(arg);
+
+  if (written > 0) {
+    *offs += written;
+  }
+}
+
+void _metrics_histogram(char *dest, size_t size, size_t *offs,
+                        const char *name, const uint64_t *histogram,
+                        uint64_t sum) {
+  _metrics_appendf(dest, size, offs, "# TYPE %s histogram\n", name);
+
+  uint64_t cumulative = 0;
+  for (int bucket = 0; bucket < MAWIMCTL_METRICS_HISTOGRAM_BUCKETS; bucket++) {
+    cumulative += histogram[bucket];
+
+    if (bucket == MAWIMCTL_METRICS_HISTOGRAM_BUCKETS - 1) {
+      _metrics_appendf(dest, size, offs, "%s_bucket{le=\"+Inf\"} %lu\n", name,
+                       cumulative);
+    } else {
+      _metrics_appendf(dest, size, offs, "%s_bucket{le=\"%lu\"} %lu\n", name,
+                       (1ul << bucket) - 1, cumulative);
+    }
+  }
+
+  _metrics_appendf(dest, size, offs, "%s_sum %lu\n%s_count %lu\n", name, sum,
+                   name, cumulative);
+}
+
+size_t mawim_metrics_prometheus(const mawimctl_metrics_t *metrics, char *dest,
+                                size_t size) {
+  size_t offs = 0;
+
+  _metrics_appendf(dest, size, &offs,
+                   "# TYPE mawim_events_handled_total counter\n");
+  for (int type = 2; type < MAWIMCTL_METRICS_EVENT_TYPES; type++) {
+    if (metrics->events_handled[type] == 0) {
+      continue;
+    }
+
+    _metrics_appendf(dest, size, &offs,
+                     "mawim_events_handled_total{type=\"%s\"} %lu\n",
+                     event_type_str[type], metrics->events_handled[type]);
+  }
+
+  _metrics_appendf(dest, size, &offs,
+                   "# TYPE mawim_events_unhandled_total counter\n"
+                   "mawim_events_unhandled_total %lu\n",
+                   metrics->events_unhandled);
+  _metrics_histogram(dest, size, &offs, "mawim_event_latency_us",
+                     metrics->event_latency_us, metrics->event_latency_us_sum);
+
+  _metrics_appendf(dest, size, &offs,
+                   "# TYPE mawim_x_requests_total counter\n"
+                   "mawim_x_requests_total %lu\n"
+                   "# TYPE mawim_x_round_trips_total counter\n"
+                   "mawim_x_round_trips_total %lu\n"
+                   "# TYPE mawim_layout_passes_total counter\n"
+                   "mawim_layout_passes_total %lu\n",
+                   metrics->x_requests, metrics->x_round_trips,
+                   metrics->layout_passes);
+  _metrics_histogram(dest, size, &offs, "mawim_windows_reconfigured_per_pass",
+                     metrics->windows_reconfigured_per_pass,
+                     metrics->windows_reconfigured);
+
+  _metrics_appendf(dest, size, &offs,
+                   "# TYPE mawim_commands_handled_total counter\n");
+  for (int cmd = 0; cmd < MAWIMCTL_CMD_INVALID; cmd++) {
+    _metrics_appendf(dest, size, &offs,
+                     "mawim_commands_handled_total{command=\"%s\"} %lu\n",
+                     ctl_command_str[cmd], metrics->commands_handled[cmd]);
+  }
+
+  _metrics_histogram(dest, size, &offs, "mawim_command_latency_us",
+                     metrics->command_latency_us,
+                     metrics->command_latency_us_sum);
+
+  _metrics_appendf(dest, size, &offs,
+                   "# TYPE mawim_command_queue_depth gauge\n"
+                   "mawim_command_queue_depth %lu\n"
+                   "# TYPE mawim_command_queue_depth_max gauge\n"
+                   "mawim_command_queue_depth_max %lu\n",
+                   metrics->command_queue_depth,
+                   metrics->command_queue_depth_max);
+
+  return offs < size ? offs : size - 1;
+}
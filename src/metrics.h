@@ -0,0 +1,41 @@
+/* metrics.h ; MaWiM runtime performance counters
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "mawimctl.h"
+
+#include <stddef.h>
+
+extern mawimctl_metrics_t mawim_metrics;
+
+/**
+ * @brief Gets a monotonic timestamp for latency measurements
+ * @return The timestamp in nanoseconds
+ */
+uint64_t mawim_metrics_now_ns(void);
+
+/**
+ * @brief Counts a value into a histogram with MAWIMCTL_METRICS_HISTOGRAM_BUCKETS
+ * log2 buckets
+ * @param histogram The histogram
+ * @param value The value to be counted
+ */
+void mawim_metrics_histogram_add(uint64_t *histogram, uint64_t value);
+
+/**
+ * @brief Formats metrics in the Prometheus text exposition format
+ * @param metrics The metrics to be formatted
+ * @param dest The destination buffer
+ * @param size The size of the destination buffer
+ * @return The length of the written text, excluding the NULL-terminator
+ */
+size_t mawim_metrics_prometheus(const mawimctl_metrics_t *metrics, char *dest,
+                                size_t size);
+
+#endif /* #ifndef METRICS_H */
@@ -0,0 +1,233 @@
+/* record.c ; MaWiM event recording and replay
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "record.h"
+
+#include "commands.h"
+#include "events.h"
+#include "logging.h"
+#include "mawim.h"
+#include "workspace.h"
+#include "xmem.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static FILE *record_file = NULL;
+static uint64_t record_start_ns = 0;
+static bool record_pending = false;
+
+uint64_t _record_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+size_t _record_event_size(int type) {
+  switch (type) {
+  case ButtonPress:
+  case ButtonRelease:
+    return sizeof(XButtonEvent);
+  case EnterNotify:
+  case LeaveNotify:
+    return sizeof(XCrossingEvent);
+  case CreateNotify:
+    return sizeof(XCreateWindowEvent);
+  case DestroyNotify:
+    return sizeof(XDestroyWindowEvent);
+  case UnmapNotify:
+    return sizeof(XUnmapEvent);
+  case MapNotify:
+    return sizeof(XMapEvent);
+  case MapRequest:
+    return sizeof(XMapRequestEvent);
+  case ReparentNotify:
+    return sizeof(XReparentEvent);
+  case ConfigureNotify:
+    return sizeof(XConfigureEvent);
+  case ConfigureRequest:
+    return sizeof(XConfigureRequestEvent);
+  default:
+    return sizeof(XEvent);
+  }
+}
+
+void _record_write(uint8_t kind, const void *payload, uint32_t length,
+                   const void *extra, uint32_t extra_length) {
+  uint64_t timestamp = _record_now_ns() - record_start_ns;
+  uint32_t total_length = length + extra_length;
+
+  fwrite(&kind, sizeof(kind), 1, record_file);
+  fwrite(&timestamp, sizeof(timestamp), 1, record_file);
+  fwrite(&total_length, sizeof(total_length), 1, record_file);
+  if (length > 0) {
+    fwrite(payload, length, 1, record_file);
+  }
+  if (extra_length > 0) {
+    fwrite(extra, extra_length, 1, record_file);
+  }
+
+  record_pending = true;
+}
+
+bool mawim_record_start(const char *path) {
+  record_file = fopen(path, "wbe");
+  if (record_file == NULL) {
+    mawim_logf(LOG_ERROR, "failed to open recording \"%s\": %s\n", path,
+               strerror(errno));
+    return false;
+  }
+
+  uint32_t version = MAWIM_RECORD_VERSION;
+  fwrite(MAWIM_RECORD_MAGIC, strlen(MAWIM_RECORD_MAGIC), 1, record_file);
+  fwrite(&version, sizeof(version), 1, record_file);
+
+  record_start_ns = _record_now_ns();
+  mawim_logf(LOG_INFO, "recording to \"%s\"\n", path);
+
+  return true;
+}
+
+void mawim_record_stop(void) {
+  if (record_file == NULL) {
+    return;
+  }
+
+  fclose(record_file);
+  record_file = NULL;
+}
+
+void mawim_record_event(XEvent *event) {
+  if (record_file == NULL) {
+    return;
+  }
+
+  _record_write(MAWIM_RECORD_EVENT, event, _record_event_size(event->type),
+                NULL, 0);
+}
+
+void mawim_record_command(mawimctl_command_t *cmd) {
+  if (record_file == NULL) {
+    return;
+  }
+
+  uint8_t header[MAWIMCTL_COMMAND_BASESIZE - 1];
+  header[0] = cmd->command_identifier;
+  header[1] = cmd->flags;
+  memcpy(header + 2, &cmd->data_length, sizeof(cmd->data_length));
+
+  _record_write(MAWIM_RECORD_COMMAND, header, sizeof(header), cmd->data,
+                cmd->data != NULL ? cmd->data_length : 0);
+}
+
+void mawim_record_iteration(void) {
+  if (record_file == NULL || !record_pending) {
+    return;
+  }
+
+  _record_write(MAWIM_RECORD_ITERATION, NULL, 0, NULL, 0);
+  fflush(record_file);
+  record_pending = false;
+}
+
+bool mawim_replay(mawim_t *mawim, const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    mawim_logf(LOG_ERROR, "failed to open recording \"%s\": %s\n", path,
+               strerror(errno));
+    return false;
+  }
+
+  char magic[sizeof(MAWIM_RECORD_MAGIC) - 1];
+  uint32_t version;
+  if (fread(magic, sizeof(magic), 1, file) != 1 ||
+      memcmp(magic, MAWIM_RECORD_MAGIC, sizeof(magic)) != 0 ||
+      fread(&version, sizeof(version), 1, file) != 1 ||
+      version != MAWIM_RECORD_VERSION) {
+    mawim_logf(LOG_ERROR, "\"%s\" is not a valid recording!\n", path);
+    fclose(file);
+    return false;
+  }
+
+  uint8_t *payload = xmalloc(MAWIMCTL_COMMAND_MAXSIZE);
+  unsigned long first_request = NextRequest(mawim->display);
+  uint64_t start = _record_now_ns();
+  uint64_t recorded_ns = 0;
+  int events = 0;
+  int commands = 0;
+  int iterations = 0;
+  bool success = true;
+
+  uint8_t kind;
+  while (fread(&kind, sizeof(kind), 1, file) == 1) {
+    uint32_t length;
+    if (fread(&recorded_ns, sizeof(recorded_ns), 1, file) != 1 ||
+        fread(&length, sizeof(length), 1, file) != 1 ||
+        length > MAWIMCTL_COMMAND_MAXSIZE ||
+        (length > 0 && fread(payload, length, 1, file) != 1)) {
+      mawim_log(LOG_ERROR, "replay: truncated record!\n");
+      success = false;
+      break;
+    }
+
+    switch (kind) {
+    case MAWIM_RECORD_EVENT: {
+      XEvent event;
+      memset(&event, 0, sizeof(event));
+      memcpy(&event, payload, length < sizeof(event) ? length : sizeof(event));
+      event.xany.display = mawim->display;
+
+      mawim_handle_event(mawim, event);
+      events++;
+      break;
+    }
+    case MAWIM_RECORD_COMMAND: {
+      mawimctl_command_t cmd = {.sender_fd = -1,
+                                .command_identifier = payload[0],
+                                .flags = payload[1] | MAWIMCTL_FLAG_NO_RESPONSE,
+                                .data = NULL};
+      memcpy(&cmd.data_length, payload + 2, sizeof(cmd.data_length));
+      if (length > MAWIMCTL_COMMAND_BASESIZE - 1) {
+        cmd.data = payload + MAWIMCTL_COMMAND_BASESIZE - 1;
+      }
+
+      mawim_handle_ctl_command(mawim, cmd);
+      commands++;
+      break;
+    }
+    case MAWIM_RECORD_ITERATION:
+      mawim_commit_workspaces(mawim);
+      iterations++;
+      break;
+    default:
+      mawim_logf(LOG_WARNING, "replay: skipping unknown record kind %d\n",
+                 kind);
+      break;
+    }
+  }
+
+  mawim_x11_flush(mawim);
+
+  uint64_t elapsed = _record_now_ns() - start;
+  unsigned long requests = NextRequest(mawim->display) - first_request;
+
+  mawim_logf(LOG_INFO,
+             "replayed %d events, %d commands in %d iterations: %.3fms "
+             "(recorded %.3fms), %lu X requests\n",
+             events, commands, iterations, elapsed / 1000000.0,
+             recorded_ns / 1000000.0, requests);
+
+  xfree(payload);
+  fclose(file);
+
+  return success;
+}
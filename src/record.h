@@ -0,0 +1,75 @@
+/* record.h ; MaWiM event recording and replay
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "types.h"
+
+#define MAWIM_RECORD_MAGIC "MAWIMREC"
+#define MAWIM_RECORD_VERSION 1
+
+/* A recording starts with the 8 byte magic followed by the version as a
+ * uint32_t. Each record consists of its kind (uint8_t), the nanoseconds since
+ * the recording was started (uint64_t), the payload length (uint32_t) and the
+ * payload itself.
+ */
+enum mawim_record_kind {
+  /* Payload is the XEvent, truncated to the size of its event structure */
+  MAWIM_RECORD_EVENT = 0,
+  /* Payload is the command identifier, flags, data length and data */
+  MAWIM_RECORD_COMMAND,
+  /* End of a main loop iteration, no payload */
+  MAWIM_RECORD_ITERATION,
+
+  /* Has to be last value */
+  MAWIM_RECORD_INVALID,
+};
+
+/**
+ * @brief Starts recording into the given file
+ * @param path Path of the file to record to, it is truncated
+ * @return true on success
+ */
+bool mawim_record_start(const char *path);
+
+/**
+ * @brief Stops recording and closes the file
+ */
+void mawim_record_stop(void);
+
+/**
+ * @brief Records an incoming X11 event, does nothing if not recording
+ * @param event The event to record
+ */
+void mawim_record_event(XEvent *event);
+
+/**
+ * @brief Records a mawimctl command, does nothing if not recording
+ * @param cmd The command to record
+ */
+void mawim_record_command(mawimctl_command_t *cmd);
+
+/**
+ * @brief Records the end of a main loop iteration and flushes the recording
+ * if anything was recorded during the iteration. Does nothing if not
+ * recording.
+ */
+void mawim_record_iteration(void);
+
+/**
+ * @brief Feeds a recording through the event and command handlers as fast as
+ * possible. Commands are handled without responding. Layouts are committed
+ * at the end of each recorded iteration. Reports the elapsed time and the
+ * amount of X requests issued.
+ * @param mawim The mawim instance, X11 has to be initialised
+ * @param path Path of the recording
+ * @return true on success
+ */
+bool mawim_replay(mawim_t *mawim, const char *path);
+
+#endif /* #ifndef RECORD_H */
@@ -0,0 +1,59 @@
+/* spsc.c ; MaWiM lock-free single producer/single consumer queue
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#include "spsc.h"
+
+#include "logging.h"
+#include "xmem.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void mawim_spsc_init(mawim_spsc_t *queue, size_t capacity,
+                     size_t element_size) {
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+  queue->capacity = capacity;
+  queue->element_size = element_size;
+  queue->slots = xmalloc(capacity * element_size);
+}
+
+void mawim_spsc_free(mawim_spsc_t *queue) {
+  xfree(queue->slots);
+  queue->slots = NULL;
+}
+
+bool mawim_spsc_push(mawim_spsc_t *queue, const void *element) {
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+  if (head - tail == queue->capacity) {
+    return false;
+  }
+
+  memcpy(queue->slots + (head & (queue->capacity - 1)) * queue->element_size,
+         element, queue->element_size);
+
+  /* Publishes the element to the consumer */
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+  return true;
+}
+
+bool mawim_spsc_pop(mawim_spsc_t *queue, void *dest) {
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+  if (head == tail) {
+    return false;
+  }
+
+  memcpy(dest,
+         queue->slots + (tail & (queue->capacity - 1)) * queue->element_size,
+         queue->element_size);
+
+  /* Hands the slot back to the producer */
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+  return true;
+}
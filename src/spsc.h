@@ -0,0 +1,65 @@
+/* spsc.h ; MaWiM lock-free single producer/single consumer queue
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* clang-format off */
+
+/* Bounded queue of fixed size elements which one thread pushes to and one
+ * other thread pops from without locking. head and tail only ever grow and
+ * are kept on separate cache lines so the threads do not contend on them.
+ */
+typedef struct mawim_spsc {
+  _Alignas(64) atomic_size_t head;
+  _Alignas(64) atomic_size_t tail;
+
+  _Alignas(64) size_t        capacity;
+  size_t                     element_size;
+  uint8_t                   *slots;
+} mawim_spsc_t;
+
+/* clang-format on */
+
+/**
+ * @brief Initialises an empty queue
+ * @param queue The queue to be initialised
+ * @param capacity The amount of elements the queue holds, has to be a power
+ * of 2
+ * @param element_size The size of a single element
+ */
+void mawim_spsc_init(mawim_spsc_t *queue, size_t capacity,
+                     size_t element_size);
+
+/**
+ * @brief Frees the storage of the queue, elements still queued are dropped
+ * @param queue The queue
+ */
+void mawim_spsc_free(mawim_spsc_t *queue);
+
+/**
+ * @brief Copies an element into the queue, only called by the producer
+ * @param queue The queue
+ * @param element The element, element_size bytes are copied
+ * @return false if the queue is full
+ */
+bool mawim_spsc_push(mawim_spsc_t *queue, const void *element);
+
+/**
+ * @brief Takes the oldest element off the queue, only called by the consumer
+ * @param queue The queue
+ * @param dest Where the element is copied to
+ * @return false if the queue is empty
+ */
+bool mawim_spsc_pop(mawim_spsc_t *queue, void *dest);
+
+#endif /* #ifndef SPSC_H */
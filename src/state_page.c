@@ -0,0 +1,136 @@
+/* state_page.c ; MaWiM shared memory state page
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "state_page.h"
+
+#include "logging.h"
+#include "metrics.h"
+#include "window.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static const char *page_name = NULL;
+static mawimctl_state_page_t *page = NULL;
+
+/* What was last published, compared against to skip writes which would not
+ * change anything.
+ */
+static mawimctl_state_page_t published;
+static uint64_t published_layout_passes;
+
+bool mawim_state_page_open(const char *name) {
+  if (name == NULL) {
+    name = MAWIMCTL_DEFAULT_STATE_PAGE_NAME;
+  }
+
+  int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0600);
+  if (fd == -1) {
+    mawim_logf(LOG_ERROR, "state_page: could not create \"%s\": %s\n", name,
+               strerror(errno));
+    return false;
+  }
+
+  if (ftruncate(fd, sizeof(*page)) == -1) {
+    mawim_logf(LOG_ERROR, "state_page: could not resize \"%s\": %s\n", name,
+               strerror(errno));
+    close(fd);
+    shm_unlink(name);
+    return false;
+  }
+
+  void *mapping =
+      mmap(NULL, sizeof(*page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (mapping == MAP_FAILED) {
+    mawim_logf(LOG_ERROR, "state_page: could not map \"%s\": %s\n", name,
+               strerror(errno));
+    shm_unlink(name);
+    return false;
+  }
+
+  page_name = name;
+  page = mapping;
+
+  memset(&published, 0, sizeof(published));
+  published.magic = MAWIMCTL_STATE_PAGE_MAGIC;
+  published.version = MAWIMCTL_STATE_PAGE_VERSION;
+  published_layout_passes = 0;
+
+  memcpy(page, &published, sizeof(published));
+
+  return true;
+}
+
+void mawim_state_page_update(mawim_t *mawim) {
+  if (page == NULL) {
+    return;
+  }
+
+  mawimctl_state_page_t current;
+  memset(&current, 0, sizeof(current));
+  current.magic = MAWIMCTL_STATE_PAGE_MAGIC;
+  current.version = MAWIMCTL_STATE_PAGE_VERSION;
+  current.active_workspace = mawim->active_workspace;
+  current.workspace_count = mawim->workspace_count;
+
+  for (mawimctl_workspaceid_t wid = 1; wid <= mawim->workspace_count; wid++) {
+    mawim_workspace_t *workspace = &mawim->workspaces[wid - 1];
+    mawimctl_state_page_workspace_t *dest = &current.workspaces[wid - 1];
+
+    for (int row = 0; row < workspace->row_count; row++) {
+      dest->window_count += mawim_get_wins_on_row(workspace, row, NULL);
+    }
+
+    dest->focused_window = workspace->focused_window != NULL
+                               ? workspace->focused_window->x11_window
+                               : 0;
+  }
+
+  /* sequence and generation are equal on both sides here */
+  current.sequence = published.sequence;
+  current.generation = published.generation;
+
+  if (published_layout_passes == mawim_metrics.layout_passes &&
+      memcmp(&current, &published, sizeof(current)) == 0) {
+    return;
+  }
+
+  current.generation++;
+  current.sequence += 2;
+
+  /* Readers see an odd sequence while the page is written */
+  __atomic_store_n(&page->sequence, published.sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  page->generation = current.generation;
+  page->active_workspace = current.active_workspace;
+  page->workspace_count = current.workspace_count;
+  memcpy(page->workspaces, current.workspaces,
+         current.workspace_count * sizeof(*current.workspaces));
+
+  __atomic_store_n(&page->sequence, current.sequence, __ATOMIC_RELEASE);
+
+  published = current;
+  published_layout_passes = mawim_metrics.layout_passes;
+}
+
+void mawim_state_page_close(void) {
+  if (page == NULL) {
+    return;
+  }
+
+  munmap(page, sizeof(*page));
+  shm_unlink(page_name);
+  page = NULL;
+}
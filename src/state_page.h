@@ -0,0 +1,35 @@
+/* state_page.h ; MaWiM shared memory state page
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#ifndef STATE_PAGE_H
+#define STATE_PAGE_H
+
+#include "types.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Creates the shared memory object the state is published in
+ * @param name The name of the object, if NULL it will default to
+ * MAWIMCTL_DEFAULT_STATE_PAGE_NAME
+ * @return true on success
+ */
+bool mawim_state_page_open(const char *name);
+
+/**
+ * @brief Publishes the current state if it changed since the last call.
+ * Called by the main loop after the layout was committed.
+ * @param mawim The mawim instance
+ */
+void mawim_state_page_update(mawim_t *mawim);
+
+/**
+ * @brief Unmaps and removes the shared memory object
+ */
+void mawim_state_page_close(void);
+
+#endif /* #ifndef STATE_PAGE_H */
@@ -0,0 +1,100 @@
+/* trace.c ; MaWiM span tracing
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+
+#include "logging.h"
+#include "xmem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TRACE_JSON_HEADER "{\"displayTimeUnit\":\"ns\",\"traceEvents\":["
+#define TRACE_JSON_FOOTER "]}"
+
+bool mawim_trace_enabled = false;
+
+static mawim_trace_span_t *spans = NULL;
+static uint64_t span_head = 0;
+
+uint64_t _trace_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void mawim_trace_enable(void) {
+  if (spans == NULL) {
+    spans = xmalloc(MAWIM_TRACE_CAPACITY * sizeof(*spans));
+  }
+
+  mawim_trace_enabled = true;
+  mawim_log(LOG_INFO, "tracing enabled\n");
+}
+
+uint64_t mawim_trace_begin(void) {
+  return mawim_trace_enabled ? _trace_now_ns() : 0;
+}
+
+void mawim_trace_end(const char *name, uint64_t begin) {
+  if (!mawim_trace_enabled) {
+    return;
+  }
+
+  mawim_trace_span_t *span = &spans[span_head & (MAWIM_TRACE_CAPACITY - 1)];
+  span->name = name;
+  span->begin_ns = begin;
+  span->duration_ns = _trace_now_ns() - begin;
+  span_head++;
+}
+
+int _trace_format_span(char *dest, size_t size, mawim_trace_span_t *span,
+                       bool first) {
+  return snprintf(dest, size,
+                  "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                  "\"ts\":%.3f,\"dur\":%.3f}",
+                  first ? "" : ",", span->name, span->begin_ns / 1000.0,
+                  span->duration_ns / 1000.0);
+}
+
+size_t mawim_trace_dump_json(char *dest, size_t size) {
+  size_t used = sizeof(TRACE_JSON_HEADER) - 1 + sizeof(TRACE_JSON_FOOTER) - 1;
+  if (size <= used) {
+    if (size > 0) {
+      dest[0] = '\0';
+    }
+    return 0;
+  }
+
+  uint64_t available = span_head < MAWIM_TRACE_CAPACITY ? span_head
+                                                        : MAWIM_TRACE_CAPACITY;
+
+  /* Walk back from the newest span to find out how many fit */
+  uint64_t first = span_head;
+  while (spans != NULL && span_head - first < available) {
+    mawim_trace_span_t *span = &spans[(first - 1) & (MAWIM_TRACE_CAPACITY - 1)];
+    size_t length = _trace_format_span(NULL, 0, span, false);
+    if (used + length >= size) {
+      break;
+    }
+
+    used += length;
+    first--;
+  }
+
+  size_t offs = snprintf(dest, size, TRACE_JSON_HEADER);
+  for (uint64_t ix = first; ix < span_head; ix++) {
+    mawim_trace_span_t *span = &spans[ix & (MAWIM_TRACE_CAPACITY - 1)];
+    offs += _trace_format_span(dest + offs, size - offs, span, ix == first);
+  }
+  offs += snprintf(dest + offs, size - offs, TRACE_JSON_FOOTER);
+
+  return offs;
+}
@@ -0,0 +1,64 @@
+/* trace.h ; MaWiM span tracing
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Has to be a power of two. MAWIMCTL_GET_TRACE sends a single response of at
+ * most UINT16_MAX bytes, spans take up to ~115 bytes of JSON each, so more than
+ * this would never be fetched.
+ */
+#ifndef MAWIM_TRACE_CAPACITY
+#define MAWIM_TRACE_CAPACITY 512
+#endif
+
+/* clang-format off */
+
+typedef struct mawim_trace_span {
+  const char *name;
+  uint64_t    begin_ns;
+  uint64_t    duration_ns;
+} mawim_trace_span_t;
+
+/* clang-format on */
+
+extern bool mawim_trace_enabled;
+
+/**
+ * @brief Enables tracing and allocates the ring buffer
+ */
+void mawim_trace_enable(void);
+
+/**
+ * @brief Begins a span
+ * @return The timestamp to be passed to mawim_trace_end, 0 if tracing is
+ * disabled
+ */
+uint64_t mawim_trace_begin(void);
+
+/**
+ * @brief Ends a span and writes it to the ring buffer, overwriting the oldest
+ * span if the buffer is full. Does nothing if tracing is disabled.
+ * @param name The name of the span, has to be a string with static lifetime
+ * @param begin The timestamp returned by mawim_trace_begin
+ */
+void mawim_trace_end(const char *name, uint64_t begin);
+
+/**
+ * @brief Writes the most recent spans which fit into dest as Chrome trace
+ * event JSON, oldest first. The output is NULL-terminated.
+ * @param dest The destination buffer
+ * @param size The size of the destination buffer
+ * @return The length of the JSON without the NULL-terminator
+ */
+size_t mawim_trace_dump_json(char *dest, size_t size);
+
+#endif /* #ifndef TRACE_H */
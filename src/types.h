@@ -8,6 +8,8 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include "config.h"
+#include "layout.h"
 #include "mawimctl_server.h"
 
 #include <X11/Xlib.h>
@@ -28,9 +30,11 @@ typedef struct window_list {
 typedef struct mawim_window {
   mawim_window_t *next;
 
-  /* X11 */
+  /* X11, changes holds the last geometry sent to the server */
   Window         x11_window;
   XWindowChanges changes;
+  bool           configured;
+  bool           mapped;
 
   /* Metadata */
   mawimctl_workspaceid_t workspace;
@@ -46,12 +50,25 @@ typedef struct mawim_window {
   int cols_on_row;
 } mawim_window_t;
 
+typedef struct mawim_row {
+  int              window_count;
+  int              capacity;
+  mawim_window_t **windows;
+} mawim_row_t;
+
 typedef struct mawim_workspace {
   window_list_t   windows;
   mawim_window_t *focused_window;
 
   int active_row;
   int row_count;
+
+  /* Row index, windows ordered by their column */
+  int          row_capacity;
+  mawim_row_t *rows;
+
+  /* Layout */
+  bool dirty;
 } mawim_workspace_t;
 
 typedef struct mawim {
@@ -63,14 +80,29 @@ typedef struct mawim {
 
   /* MaWiM */
   mawimctl_server_t *mawimctl;
+  bool               running;
 
   mawimctl_workspaceid_t workspace_count;
   mawimctl_workspaceid_t active_workspace;
   mawim_workspace_t *workspaces;
 
-  /* Configuration */
+  /* Layout */
+  mawim_geometry_table_t geometry;
+
+  /* Configuration, the fields below are taken from config on startup and
+   * on every reload
+   */
+  const char    *config_path;
+  mawim_config_t config;
+
   int max_cols;
   int max_rows;
+
+  int top_gap;
+  int bottom_gap;
+  int left_gap;
+  int right_gap;
+  int border_width;
 } mawim_t;
 
 /* clang-format on */
@@ -7,10 +7,14 @@
 
 #include "window.h"
 
+#include "commands.h"
 #include "logging.h"
 #include "mawim.h"
 #include "mawimctl.h"
+#include "metrics.h"
 #include "types.h"
+#include "window_index.h"
+#include "workspace.h"
 #include "xmem.h"
 
 #include <stdlib.h>
@@ -31,6 +35,8 @@ mawim_window_t *mawim_create_window(Window win, int x, int y, int width,
   window->height = height;
   window->row = -1;
   window->col = -1;
+  window->mapped = false;
+  window->configured = false;
 
   return window;
 }
@@ -40,178 +46,166 @@ void mawim_update_window(mawim_t *mawim, mawim_window_t *window) {
     return;
   }
 
-  if (window->workspace != mawim->active_workspace) {
-    XWithdrawWindow(mawim->display, window->x11_window, mawim->default_screen);
-  } else {
+  bool should_map = window->workspace == mawim->active_workspace;
+  if (should_map && !window->mapped) {
     XMapWindow(mawim->display, window->x11_window);
+  } else if (!should_map && window->mapped) {
+    XWithdrawWindow(mawim->display, window->x11_window, mawim->default_screen);
   }
+  window->mapped = should_map;
 
-  mawim_workspace_t *workspace = &mawim->workspaces[window->workspace - 1];
-
-  /* Calculate */
-  int count = mawim_get_wins_on_row(&workspace->windows, window->workspace,
-                                    window->row, NULL);
-
-  mawim_logf(LOG_DEBUG, "active workspace: %d, window workspace: %d\n",
-             mawim->active_workspace, window->workspace);
+  /* Only send what changed since the last configure */
+  int mask = 0;
+  if (!window->configured || window->changes.x != window->x) {
+    mask |= CWX;
+  }
+  if (!window->configured || window->changes.y != window->y) {
+    mask |= CWY;
+  }
+  if (!window->configured || window->changes.width != window->width) {
+    mask |= CWWidth;
+  }
+  if (!window->configured || window->changes.height != window->height) {
+    mask |= CWHeight;
+  }
 
-  window->width =
-      DisplayWidth(mawim->display, mawim->default_screen) / max(count, 1);
-  window->height = DisplayHeight(mawim->display, mawim->default_screen) /
-                   workspace->row_count;
-  window->x = window->width * window->col;
-  window->y = window->height * window->row;
+  if (mask == 0) {
+    return;
+  }
 
-  mawim_logf(LOG_DEBUG,
-             "New Dimensions: ar %d slot %dx%d, size %dx%d, pos %dx%d\n",
-             workspace->row_count, window->col, window->row, window->width,
-             window->height, window->x, window->y);
+  mawim_logf(LOG_DEBUG, "Dimensions: slot %dx%d, size %dx%d, pos %dx%d\n",
+             window->col, window->row, window->width, window->height,
+             window->x, window->y);
 
-  /* Apply */
   window->changes.x = window->x;
   window->changes.y = window->y;
   window->changes.width = window->width;
   window->changes.height = window->height;
+  window->configured = true;
+  mawim_metrics.windows_reconfigured++;
 
-  int mask = CWX | CWY | CWWidth | CWHeight;
   XConfigureWindow(mawim->display, window->x11_window, mask, &window->changes);
-  mawim_x11_flush(mawim);
+}
+
+void mawim_send_configure_notify(mawim_t *mawim, mawim_window_t *window,
+                                 int border_width) {
+  XConfigureEvent event = {.type = ConfigureNotify,
+                           .display = mawim->display,
+                           .event = window->x11_window,
+                           .window = window->x11_window,
+                           .x = window->changes.x,
+                           .y = window->changes.y,
+                           .width = window->changes.width,
+                           .height = window->changes.height,
+                           .border_width = border_width,
+                           .above = None,
+                           .override_redirect = false};
+
+  XSendEvent(mawim->display, window->x11_window, false, StructureNotifyMask,
+             (XEvent *)&event);
+}
+
+void mawim_paint_window_border(mawim_t *mawim, mawim_window_t *window) {
+  if (window == NULL) {
+    return;
+  }
+
+  bool focused =
+      mawim->workspaces[window->workspace - 1].focused_window == window;
+
+  /* Assumes a TrueColor visual where 0xRRGGBB is the pixel value */
+  XSetWindowBorder(mawim->display, window->x11_window,
+                   focused ? mawim->config.active_border_color
+                           : mawim->config.inactive_border_color);
 }
 
 bool mawim_manage_window(mawim_t *mawim, mawim_window_t *window) {
   mawim_workspace_t *workspace = &mawim->workspaces[window->workspace - 1];
 
-  if (mawim_find_window(&workspace->windows, window->x11_window) == NULL) {
+  mawimctl_workspaceid_t indexed_workspace;
+  if (mawim_window_index_find(window->x11_window, &indexed_workspace) !=
+          window ||
+      indexed_workspace != window->workspace) {
     return false;
   }
 
-  bool new_row = false;
-
   if (window->row < 0) {
-    window->row = workspace->active_row;
+    int row = workspace->active_row;
     mawim_logf(LOG_DEBUG, "Attempting to manage on current active row %d\n",
-               workspace->active_row);
-    if (mawim_get_wins_on_row(&workspace->windows, window->workspace,
-                              window->row, NULL) == mawim->max_rows) {
-      int old = window->row;
-      window->row = min(window->row + 1, mawim->max_rows - 1);
+               row);
 
-      /* New Row Created */
-      new_row = old != window->row;
+    if (mawim_get_wins_on_row(workspace, row, NULL) >= mawim->max_cols) {
+      int next = min(row + 1, mawim->max_rows - 1);
 
-      if (new_row) {
-        workspace->row_count++;
+      /* Move on to the next row if there is one left */
+      if (next != row) {
+        row = next;
+        workspace->active_row = row;
       }
     }
-  }
 
-  mawim_window_t **row_wins;
-  int wins = mawim_get_wins_on_row(&workspace->windows, window->workspace,
-                                   window->row, &row_wins);
+    window->row = row;
+    mawim_row_append_window(workspace, window);
 
-  if (window->col < 0) {
-    window->col = wins - 1;
-  }
-
-  mawim_update_window(mawim, window);
+    XSetWindowBorderWidth(mawim->display, window->x11_window,
+                          mawim->border_width);
+    mawim_paint_window_border(mawim, window);
 
-  if (!new_row) {
-    for (int i = 0; i < wins; i++) {
-      mawim_update_window(mawim, row_wins[i]);
-    }
-  } else {
-    workspace->active_row = window->row;
-
-    mawim_window_t *current = workspace->windows.first;
-    mawim_update_window(mawim, current);
-
-    while (current->next != NULL) {
-      current = current->next;
-      mawim_update_window(mawim, current);
-    }
+    mawim_publish_event(mawim, MAWIMCTL_EVENT_WINDOW_MANAGED, window->workspace,
+                        0, window->x11_window);
   }
 
-  xfree(row_wins);
+  mawim_mark_workspace_dirty(mawim, window->workspace);
 
   return true;
 }
 
 void mawim_unmanage_window(mawim_t *mawim, mawim_window_t *window) {
   int oldrow = window->row;
-  int oldcol = window->col;
   int oldworkspace = window->workspace;
 
-  /* Set row and col to -1 to avoid counting this window with
-   * mawim_get_wins_on_row().
-   */
-  window->row = -1;
-  window->col = -1;
+  if (oldrow < 0) {
+    return;
+  }
 
   mawim_workspace_t *workspace = &mawim->workspaces[oldworkspace - 1];
 
-  mawim_window_t **row_windows;
-  int window_count = mawim_get_wins_on_row(&workspace->windows, oldworkspace,
-                                           oldrow, &row_windows);
+  mawim_row_remove_window(workspace, window);
 
-  if (window_count > 0) {
-    /* Update Windows on Same Row */
-    for (int ix = 0; ix < window_count; ix++) {
-      if (row_windows[ix]->col > oldcol) {
-        row_windows[ix]->col--;
-      }
-    }
+  if (workspace->rows[oldrow].window_count == 0 && workspace->row_count > 1) {
+    /* Move the rows below up one, the now empty row is recycled as the last
+     * row so its member buffer is kept around.
+     */
+    mawim_row_t empty = workspace->rows[oldrow];
 
-    for (int ix = 0; ix < window_count; ix++) {
-      if (row_windows[ix]->x11_window == window->x11_window) {
-        continue;
+    for (int crow = oldrow + 1; crow < workspace->row_count; crow++) {
+      mawim_row_t *row = &workspace->rows[crow];
+      for (int cwin = 0; cwin < row->window_count; cwin++) {
+        row->windows[cwin]->row--;
       }
-      mawim_update_window(mawim, row_windows[ix]);
-    }
-
-    xfree(row_windows);
-  } else if (workspace->row_count > 1) {
-    /* Move Windows which are a row below up one */
-
-    xfree(row_windows);
 
-    if ((workspace->row_count - 1) > oldrow) {
-      for (int crow = oldrow + 1; crow < workspace->row_count; crow++) {
-        window_count = mawim_get_wins_on_row(&workspace->windows, oldworkspace,
-                                             crow, &row_windows);
-
-        for (int cwin = 0; cwin < window_count; cwin++) {
-          row_windows[cwin]->row--;
-        }
-
-        xfree(row_windows);
-      }
+      workspace->rows[crow - 1] = *row;
     }
 
     workspace->row_count--;
+    workspace->rows[workspace->row_count] = empty;
 
     if ((workspace->active_row + 1) > workspace->row_count) {
       workspace->active_row = workspace->row_count - 1;
     }
-
-    mawim_update_all_windows(mawim);
   }
+
+  mawim_publish_event(mawim, MAWIMCTL_EVENT_WINDOW_UNMANAGED, oldworkspace, 0,
+                      window->x11_window);
+
+  mawim_mark_workspace_dirty(mawim, oldworkspace);
 }
 
 void mawim_update_all_windows(mawim_t *mawim) {
   mawim_log(LOG_DEBUG, "Update ALL Windows!\n");
 
-  for (mawimctl_workspaceid_t wid = 0; wid < mawim->workspace_count; wid++) {
-    mawim_window_t *current = mawim->workspaces[wid].windows.first;
-    if (current == NULL) {
-      continue;
-    }
-
-    mawim_update_window(mawim, current);
-
-    while (current->next != NULL) {
-      current = current->next;
-      mawim_update_window(mawim, current);
-    }
+  for (mawimctl_workspaceid_t wid = 1; wid <= mawim->workspace_count; wid++) {
+    mawim_mark_workspace_dirty(mawim, wid);
   }
 }
 
@@ -230,52 +224,20 @@ mawim_window_t *mawim_find_window(window_list_t *list, Window window) {
   return current->x11_window == window ? current : NULL;
 }
 
-int mawim_get_wins_on_row(window_list_t *list, mawimctl_workspaceid_t workspace,
-                          int row, mawim_window_t ***dest) {
-  if (list->first == NULL) {
-    return 0;
-  }
-
-  mawim_window_t *current = list->first;
-  int count = current->row == row ? 1 : 0;
-
-  while (current->next != NULL) {
-    current = current->next;
-    if (current->row == row && current->workspace == workspace) {
-      count++;
-    }
-
-    /* sanity check */
-    if (current != NULL && current == current->next) {
-      mawim_panic("circular linked list!\n");
+int mawim_get_wins_on_row(mawim_workspace_t *workspace, int row,
+                          mawim_window_t ***dest) {
+  if (row < 0 || row >= workspace->row_capacity) {
+    if (dest != NULL) {
+      *dest = NULL;
     }
+    return 0;
   }
 
-  /* Early exit if list of windows is not wanted */
-  if (dest == NULL) {
-    return count;
-  }
-
-  /* Loop a second time to get all the windows */
-
-  *dest = xmalloc(sizeof(mawim_window_t *) * count);
-  current = list->first;
-
-  int wix = 0;
-  if (current->row == row) {
-    (*dest)[wix] = current;
-    wix++;
-  }
-
-  while (current->next != NULL && wix < count) {
-    current = current->next;
-    if (current->row == row && current->workspace == workspace) {
-      (*dest)[wix] = current;
-      wix++;
-    }
+  if (dest != NULL) {
+    *dest = workspace->rows[row].windows;
   }
 
-  return count;
+  return workspace->rows[row].window_count;
 }
 
 void mawim_append_window(window_list_t *list, mawim_window_t *mawim_window) {
@@ -284,6 +246,7 @@ void mawim_append_window(window_list_t *list, mawim_window_t *mawim_window) {
   }
 
   mawim_window->next = NULL;
+  mawim_window_index_insert(mawim_window);
 
   if (list->first == NULL) {
     mawim_logf(LOG_DEBUG, "SET FIRST WINDOW (%p)\n", mawim_window);
@@ -320,6 +283,13 @@ void mawim_remove_window(window_list_t *windows, Window window,
     current = current->next;
   }
 
+  if (current->x11_window != window) {
+    mawim_log(LOG_DEBUG, "remove_window: window is not in the list\n");
+    return;
+  }
+
+  mawim_window_index_remove(window);
+
   if (previous != NULL) {
     previous->next = current->next;
   }
@@ -336,6 +306,65 @@ void mawim_remove_window(window_list_t *windows, Window window,
   }
 }
 
+/* row operations */
+
+void mawim_row_append_window(mawim_workspace_t *workspace,
+                             mawim_window_t *window) {
+  if (window->row >= workspace->row_capacity) {
+    int new_capacity = max(window->row + 1, workspace->row_capacity * 2);
+    workspace->rows =
+        xrealloc(workspace->rows, new_capacity * sizeof(*workspace->rows));
+
+    for (int ix = workspace->row_capacity; ix < new_capacity; ix++) {
+      workspace->rows[ix].window_count = 0;
+      workspace->rows[ix].capacity = 0;
+      workspace->rows[ix].windows = NULL;
+    }
+
+    workspace->row_capacity = new_capacity;
+  }
+
+  mawim_row_t *row = &workspace->rows[window->row];
+  if (row->window_count == row->capacity) {
+    row->capacity = max(row->capacity * 2, 4);
+    row->windows =
+        xrealloc(row->windows, row->capacity * sizeof(*row->windows));
+  }
+
+  window->col = row->window_count;
+  row->windows[row->window_count] = window;
+  row->window_count++;
+
+  if (window->row >= workspace->row_count) {
+    workspace->row_count = window->row + 1;
+  }
+}
+
+void mawim_row_remove_window(mawim_workspace_t *workspace,
+                             mawim_window_t *window) {
+  if (window->row < 0 || window->row >= workspace->row_capacity) {
+    return;
+  }
+
+  mawim_row_t *row = &workspace->rows[window->row];
+  if (window->col < 0 || window->col >= row->window_count ||
+      row->windows[window->col] != window) {
+    mawim_log(LOG_WARNING, "row_remove_window: window is not on its row!\n");
+    return;
+  }
+
+  /* Close the gap, every window right of the removed one moves left */
+  for (int ix = window->col + 1; ix < row->window_count; ix++) {
+    row->windows[ix - 1] = row->windows[ix];
+    row->windows[ix - 1]->col--;
+  }
+
+  row->window_count--;
+
+  window->row = -1;
+  window->col = -1;
+}
+
 void mawim_destroy_window_list(window_list_t *list) {
   if (list->first == NULL) {
     return;
@@ -345,9 +374,11 @@ void mawim_destroy_window_list(window_list_t *list) {
 
   while (current->next != NULL) {
     mawim_window_t *next = current->next;
+    mawim_window_index_remove(current->x11_window);
     xfree(current);
     current = next;
   }
 
+  mawim_window_index_remove(current->x11_window);
   xfree(current);
 }
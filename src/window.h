@@ -25,14 +25,37 @@ mawim_window_t *mawim_create_window(Window win, int x, int y, int width,
                                     int height);
 
 /**
- * @brief Updates a window's geometry and configures it
+ * @brief Configures the window to its geometry and maps or withdraws it
+ * depending on its workspace. Only the parts differing from the last
+ * configuration or map state are sent. The geometry itself is computed by
+ * mawim_update_workspace(). The requests are not flushed, this is left to the
+ * caller.
  * @param mawim The mawim instance
  * @param window The window to be updated
  */
 void mawim_update_window(mawim_t *mawim, mawim_window_t *window);
 
 /**
- * @brief Begin managing a window
+ * @brief Sends the window a synthetic ConfigureNotify holding the geometry it
+ * was last configured to. Not flushed.
+ * @param mawim The mawim instance
+ * @param window The window, has to be configured already
+ * @param border_width The window's current border width
+ */
+void mawim_send_configure_notify(mawim_t *mawim, mawim_window_t *window,
+                                 int border_width);
+
+/**
+ * @brief Sets the border color of a window depending on whether it is the
+ * focused window of its workspace
+ * @param mawim The mawim instance
+ * @param window The window, may be NULL
+ */
+void mawim_paint_window_border(mawim_t *mawim, mawim_window_t *window);
+
+/**
+ * @brief Begin managing a window. The window's workspace is marked dirty and
+ * gets laid out on the next mawim_commit_workspaces() call.
  * @param mawim The mawim instance
  * @param window The window to be managed
  * @param event The ConfigureRequestEvent causing this management call
@@ -41,14 +64,16 @@ void mawim_update_window(mawim_t *mawim, mawim_window_t *window);
 bool mawim_manage_window(mawim_t *mawim, mawim_window_t *window);
 
 /**
- * @brief Stop managing a window
+ * @brief Stop managing a window. The window's workspace is marked dirty and
+ * gets laid out on the next mawim_commit_workspaces() call.
  * @param mawim The mawim instance
  * @param window The window to be unmanaged
  */
 void mawim_unmanage_window(mawim_t *mawim, mawim_window_t *window);
 
 /**
- * @brief Update all the windows
+ * @brief Marks all workspaces dirty so that every window gets updated on the
+ * next mawim_commit_workspaces() call
  * @param mawim The mawim instance
  */
 void mawim_update_all_windows(mawim_t *mawim);
@@ -65,26 +90,28 @@ void mawim_update_all_windows(mawim_t *mawim);
 mawim_window_t *mawim_find_window(window_list_t *list, Window window);
 
 /**
- * @brief Finds all windows on the given row
- * @param list The list to operate on
+ * @brief Gets the windows on the given row of a workspace. This takes constant
+ * time and does not allocate.
  * @param workspace The workspace to search in
  * @param row The row where the windows are to be searched
- * @param dest (nullable) The destination mawim_window_t* array
+ * @param dest (nullable) Will be pointed to the row's windows ordered by their
+ * column. The array is owned by the workspace and must not be freed.
  * @return Count of windows on the row in the specified workspace
  */
-int mawim_get_wins_on_row(window_list_t *list, mawimctl_workspaceid_t workspace,
-                          int row, mawim_window_t ***dest);
+int mawim_get_wins_on_row(mawim_workspace_t *workspace, int row,
+                          mawim_window_t ***dest);
 
 /**
- * @brief Appends the given mawim window to the list. The next field of the
- * passed window will be NULLed
+ * @brief Appends the given mawim window to the list and the window index. The
+ * next field of the passed window will be NULLed and its workspace field has to
+ * be set already
  * @param list The list to operate on
  * @param mawim_window The window to be appended
  */
 void mawim_append_window(window_list_t *list, mawim_window_t *mawim_window);
 
 /**
- * @brief Removes the given window from the window list
+ * @brief Removes the given window from the window list and the window index
  * @param windows The list to operate on
  * @param window The X11 window associated with the mawim_window_t structure to
  * be removed
@@ -92,6 +119,28 @@ void mawim_append_window(window_list_t *list, mawim_window_t *mawim_window);
 void mawim_remove_window(window_list_t *windows, Window window,
                          bool should_free);
 
+/* row operations */
+
+/**
+ * @brief Appends the window to the end of its row in the workspace's row
+ * index, the window's row has to be set already. Its column is set to the new
+ * position.
+ * @param workspace The workspace the window is managed on
+ * @param window The window to be appended
+ */
+void mawim_row_append_window(mawim_workspace_t *workspace,
+                             mawim_window_t *window);
+
+/**
+ * @brief Removes the window from its row in the workspace's row index. The
+ * columns of all windows right of it are decremented and the window's row and
+ * col are set to -1.
+ * @param workspace The workspace the window is managed on
+ * @param window The window to be removed
+ */
+void mawim_row_remove_window(mawim_workspace_t *workspace,
+                             mawim_window_t *window);
+
 /**
  * @brief Destroys the given window list
  * @param list The list to destroy
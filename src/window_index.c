@@ -0,0 +1,154 @@
+/* window_index.c ; MaWiM X11 Window to mawim_window_t index
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#include "window_index.h"
+
+#include "logging.h"
+#include "xmem.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* clang-format off */
+
+typedef struct window_index_entry {
+  Window                  x11_window;
+  mawim_window_t         *window;
+  mawimctl_workspaceid_t  workspace;
+} window_index_entry_t;
+
+/* clang-format on */
+
+/* Open addressing with linear probing. The capacity is always a power of two
+ * and the table is kept at most half full, an entry with window == NULL is
+ * free.
+ */
+static window_index_entry_t *entries = NULL;
+static size_t capacity = 0;
+static size_t count = 0;
+
+size_t _index_slot_of(Window x11_window) {
+  /* fibonacci hashing, X11 ids only differ in their lower bits */
+  return (size_t)(((uint64_t)x11_window * 0x9e3779b97f4a7c15ull) >> 32) &
+         (capacity - 1);
+}
+
+void _index_place(window_index_entry_t entry) {
+  size_t slot = _index_slot_of(entry.x11_window);
+  while (entries[slot].window != NULL &&
+         entries[slot].x11_window != entry.x11_window) {
+    slot = (slot + 1) & (capacity - 1);
+  }
+
+  if (entries[slot].window == NULL) {
+    count++;
+  }
+
+  entries[slot] = entry;
+}
+
+void _index_grow(void) {
+  window_index_entry_t *old_entries = entries;
+  size_t old_capacity = capacity;
+
+  capacity = capacity == 0 ? MAWIM_WINDOW_INDEX_INITIAL_CAPACITY : capacity * 2;
+  entries = xmalloc(capacity * sizeof(*entries));
+  for (size_t ix = 0; ix < capacity; ix++) {
+    entries[ix].window = NULL;
+  }
+
+  count = 0;
+  for (size_t ix = 0; ix < old_capacity; ix++) {
+    if (old_entries[ix].window != NULL) {
+      _index_place(old_entries[ix]);
+    }
+  }
+
+  if (old_entries != NULL) {
+    xfree(old_entries);
+  }
+}
+
+void mawim_window_index_insert(mawim_window_t *window) {
+  if (window == NULL) {
+    return;
+  }
+
+  if ((count + 1) * 2 > capacity) {
+    _index_grow();
+  }
+
+  window_index_entry_t entry = {.x11_window = window->x11_window,
+                                .window = window,
+                                .workspace = window->workspace};
+  _index_place(entry);
+}
+
+void mawim_window_index_remove(Window x11_window) {
+  if (count == 0) {
+    return;
+  }
+
+  size_t slot = _index_slot_of(x11_window);
+  while (entries[slot].window != NULL &&
+         entries[slot].x11_window != x11_window) {
+    slot = (slot + 1) & (capacity - 1);
+  }
+
+  if (entries[slot].window == NULL) {
+    return;
+  }
+
+  /* Backward shift deletion: pull every following entry of the probe chain
+   * which may live in the freed slot into it, so lookups never need
+   * tombstones.
+   */
+  size_t hole = slot;
+  size_t next = (hole + 1) & (capacity - 1);
+  while (entries[next].window != NULL) {
+    size_t home = _index_slot_of(entries[next].x11_window);
+    if (((next - home) & (capacity - 1)) >= ((next - hole) & (capacity - 1))) {
+      entries[hole] = entries[next];
+      hole = next;
+    }
+    next = (next + 1) & (capacity - 1);
+  }
+
+  entries[hole].window = NULL;
+  count--;
+}
+
+mawim_window_t *
+mawim_window_index_find(Window x11_window,
+                        mawimctl_workspaceid_t *out_workspaceid) {
+  if (count == 0) {
+    return NULL;
+  }
+
+  size_t slot = _index_slot_of(x11_window);
+  while (entries[slot].window != NULL) {
+    if (entries[slot].x11_window == x11_window) {
+      if (out_workspaceid != NULL) {
+        *out_workspaceid = entries[slot].workspace;
+      }
+      return entries[slot].window;
+    }
+    slot = (slot + 1) & (capacity - 1);
+  }
+
+  return NULL;
+}
+
+void mawim_window_index_destroy(void) {
+  if (entries != NULL) {
+    xfree(entries);
+  }
+
+  entries = NULL;
+  capacity = 0;
+  count = 0;
+}
@@ -0,0 +1,46 @@
+/* window_index.h ; MaWiM X11 Window to mawim_window_t index
+ *
+ * Copyright (c) 2024, Marie Eckert
+ * Licensed under the BSD 3-Clause License; See the LICENSE file for further
+ * information.
+ */
+
+#ifndef WINDOW_INDEX_H
+#define WINDOW_INDEX_H
+
+#include "types.h"
+
+#ifndef MAWIM_WINDOW_INDEX_INITIAL_CAPACITY
+#define MAWIM_WINDOW_INDEX_INITIAL_CAPACITY 64
+#endif
+
+/**
+ * @brief Inserts the given window into the index, replacing any previous
+ * entry for its X11 window. The owning workspace is taken from the window's
+ * workspace field.
+ * @param window The window to be indexed
+ */
+void mawim_window_index_insert(mawim_window_t *window);
+
+/**
+ * @brief Removes the entry for the given X11 window from the index
+ * @param x11_window The X11 window whose entry should be removed
+ */
+void mawim_window_index_remove(Window x11_window);
+
+/**
+ * @brief Looks up the given X11 window in constant time
+ * @param x11_window The X11 window to search with
+ * @param out_workspaceid If not NULL, the ID of the workspace owning the window
+ * will be written to it.
+ * @return NULL if the window is not indexed, otherwise pointer to the window
+ */
+mawim_window_t *mawim_window_index_find(Window x11_window,
+                                        mawimctl_workspaceid_t *out_workspaceid);
+
+/**
+ * @brief Frees the index. The windows themselves are not freed.
+ */
+void mawim_window_index_destroy(void);
+
+#endif /* #ifndef WINDOW_INDEX_H */
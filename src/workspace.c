@@ -7,37 +7,214 @@
 
 #include "workspace.h"
 
+#include "commands.h"
+#include "layout.h"
+#include "logging.h"
+#include "mawim.h"
 #include "mawimctl.h"
+#include "metrics.h"
+#include "trace.h"
 #include "window.h"
+#include "window_index.h"
+#include "xmem.h"
+
+void _update_workspace_windows(mawim_t *mawim, mawim_workspace_t *workspace) {
+  mawim_window_t *current = workspace->windows.first;
+
+  while (current != NULL) {
+    mawim_update_window(mawim, current);
+    current = current->next;
+  }
+}
 
 void mawim_activate_workspace(mawim_t *mawim,
-                              mawimctl_workspaceid_t workspace) {}
+                              mawimctl_workspaceid_t workspace) {
+  if (workspace < 1 || workspace > mawim->workspace_count ||
+      workspace == mawim->active_workspace) {
+    return;
+  }
 
-void mawim_update_workspace(mawim_t *mawim, mawimctl_workspaceid_t workspace) {}
+  mawimctl_workspaceid_t previous = mawim->active_workspace;
+  mawim_workspace_t *outgoing = &mawim->workspaces[previous - 1];
+  mawim_workspace_t *incoming = &mawim->workspaces[workspace - 1];
 
-void mawim_update_workspaces(mawim_t *mawim) {}
+  mawim->active_workspace = workspace;
 
-mawim_window_t *
-mawim_find_window_in_workspaces(mawim_t *mawim, Window x11_window,
-                                window_list_t **out_window_list,
-                                mawimctl_workspaceid_t *out_workspaceid) {
-  for (mawimctl_workspaceid_t wid = 0; wid < mawim->workspace_count; wid++) {
-    mawim_window_t *win =
-        mawim_find_window(&mawim->workspaces[wid].windows, x11_window);
-    if (win == NULL) {
-      continue;
+  /* Windows keep their geometry while hidden, so this only withdraws the
+   * outgoing and maps the incoming windows. A dirty workspace is laid out
+   * and mapped by the next commit instead, mapping it here would show the
+   * stale geometry first.
+   */
+  if (!outgoing->dirty) {
+    _update_workspace_windows(mawim, outgoing);
+  }
+
+  if (!incoming->dirty) {
+    _update_workspace_windows(mawim, incoming);
+  }
+
+  mawim_publish_event(mawim, MAWIMCTL_EVENT_WORKSPACE_SWITCHED, workspace,
+                      previous, 0);
+
+  mawim_logf(LOG_DEBUG, "activated workspace %d\n", workspace);
+}
+
+void mawim_update_workspace(mawim_t *mawim, mawimctl_workspaceid_t workspace) {
+  uint64_t trace_begin = mawim_trace_begin();
+  uint64_t reconfigured = mawim_metrics.windows_reconfigured;
+  mawim_workspace_t *ws = &mawim->workspaces[workspace - 1];
+
+  int row_lengths[ws->row_count];
+  for (int row = 0; row < ws->row_count; row++) {
+    row_lengths[row] = mawim_get_wins_on_row(ws, row, NULL);
+  }
+
+  mawim_layout_t layout = {
+      .screen = {.x = 0,
+                 .y = 0,
+                 .width = DisplayWidth(mawim->display, mawim->default_screen),
+                 .height =
+                     DisplayHeight(mawim->display, mawim->default_screen)},
+      .top_gap = mawim->top_gap,
+      .bottom_gap = mawim->bottom_gap,
+      .left_gap = mawim->left_gap,
+      .right_gap = mawim->right_gap,
+      .border_width = mawim->border_width,
+      .row_count = ws->row_count,
+      .row_lengths = row_lengths,
+  };
+
+  mawim_geometry_table_t *geometry = &mawim->geometry;
+  mawim_geometry_table_reserve(geometry, mawim_layout_window_count(&layout));
+  if (!mawim_layout_tile(&layout, geometry)) {
+    mawim_logf(LOG_ERROR, "failed to lay out workspace %d\n", workspace);
+    return;
+  }
+
+  /* Apply, the table is ordered just like the row index */
+  int ix = 0;
+  for (int row = 0; row < ws->row_count; row++) {
+    mawim_window_t **windows;
+    int count = mawim_get_wins_on_row(ws, row, &windows);
+
+    for (int col = 0; col < count; col++, ix++) {
+      mawim_window_t *window = windows[col];
+      window->x = geometry->x[ix];
+      window->y = geometry->y[ix];
+      window->width = geometry->width[ix];
+      window->height = geometry->height[ix];
+      window->cols_on_row = count;
+
+      mawim_update_window(mawim, window);
     }
+  }
 
-    if (out_window_list != NULL) {
-      *out_window_list = &mawim->workspaces[wid].windows;
+  mawim_trace_end("layout", trace_begin);
+
+  mawim_metrics.layout_passes++;
+  mawim_metrics_histogram_add(mawim_metrics.windows_reconfigured_per_pass,
+                              mawim_metrics.windows_reconfigured -
+                                  reconfigured);
+}
+
+void mawim_update_workspaces(mawim_t *mawim) {
+  for (mawimctl_workspaceid_t wid = 1; wid <= mawim->workspace_count; wid++) {
+    mawim_update_workspace(mawim, wid);
+  }
+}
+
+void mawim_reflow_workspace(mawim_t *mawim, mawimctl_workspaceid_t workspace) {
+  mawim_workspace_t *ws = &mawim->workspaces[workspace - 1];
+
+  int count = 0;
+  for (int row = 0; row < ws->row_count; row++) {
+    count += mawim_get_wins_on_row(ws, row, NULL);
+  }
+
+  if (count == 0) {
+    return;
+  }
+
+  /* Take all windows off the row index, row by row, then fill the rows up
+   * again the same way mawim_manage_window() does.
+   */
+  mawim_window_t **windows = xmalloc(count * sizeof(*windows));
+  int ix = 0;
+  for (int row = 0; row < ws->row_count; row++) {
+    mawim_window_t **row_windows;
+    int row_count = mawim_get_wins_on_row(ws, row, &row_windows);
+    for (int col = 0; col < row_count; col++) {
+      windows[ix++] = row_windows[col];
     }
+    ws->rows[row].window_count = 0;
+  }
+
+  ws->row_count = 1;
 
-    if (out_workspaceid != NULL) {
-      /* increment by one because workspace ids are 1-based */
-      *out_workspaceid = wid + 1;
+  int row = 0;
+  for (ix = 0; ix < count; ix++) {
+    if (mawim_get_wins_on_row(ws, row, NULL) >= mawim->max_cols &&
+        row + 1 < mawim->max_rows) {
+      row++;
     }
 
-    return win;
+    windows[ix]->row = row;
+    mawim_row_append_window(ws, windows[ix]);
   }
-  return NULL;
+
+  ws->active_row = row;
+  xfree(windows);
+
+  mawim_mark_workspace_dirty(mawim, workspace);
+}
+
+void mawim_mark_workspace_dirty(mawim_t *mawim,
+                                mawimctl_workspaceid_t workspace) {
+  if (workspace < 1 || workspace > mawim->workspace_count) {
+    return;
+  }
+
+  mawim->workspaces[workspace - 1].dirty = true;
+}
+
+void mawim_commit_workspaces(mawim_t *mawim) {
+  int committed = 0;
+
+  for (mawimctl_workspaceid_t wid = 1; wid <= mawim->workspace_count; wid++) {
+    if (!mawim->workspaces[wid - 1].dirty) {
+      continue;
+    }
+
+    mawim_update_workspace(mawim, wid);
+    mawim->workspaces[wid - 1].dirty = false;
+    committed++;
+  }
+
+  if (committed == 0) {
+    return;
+  }
+
+  mawim_logf(LOG_DEBUG, "committed layout of %d workspace(s)\n", committed);
+  mawim_x11_flush(mawim);
+}
+
+mawim_window_t *
+mawim_find_window_in_workspaces(mawim_t *mawim, Window x11_window,
+                                window_list_t **out_window_list,
+                                mawimctl_workspaceid_t *out_workspaceid) {
+  mawimctl_workspaceid_t wid;
+  mawim_window_t *win = mawim_window_index_find(x11_window, &wid);
+  if (win == NULL || wid < 1 || wid > mawim->workspace_count) {
+    return NULL;
+  }
+
+  if (out_window_list != NULL) {
+    *out_window_list = &mawim->workspaces[wid - 1].windows;
+  }
+
+  if (out_workspaceid != NULL) {
+    *out_workspaceid = wid;
+  }
+
+  return win;
 }
@@ -11,12 +11,15 @@
 #include "types.h"
 
 /**
- * @brief Activates a workspace (hide all other workspaces, etc.)
+ * @brief Activates a workspace. Only the windows of the previously active
+ * and the new workspace are touched: the former are withdrawn and the latter
+ * are mapped without being reconfigured. The requests are not flushed.
  */
 void mawim_activate_workspace(mawim_t *mawim, mawimctl_workspaceid_t workspace);
 
 /**
- * @brief Update the specified workspace
+ * @brief Update the specified workspace. This computes the geometry of all of
+ * its windows through the layout engine and configures them without flushing.
  */
 void mawim_update_workspace(mawim_t *mawim, mawimctl_workspaceid_t workspace);
 
@@ -26,7 +29,29 @@ void mawim_update_workspace(mawim_t *mawim, mawimctl_workspaceid_t workspace);
 void mawim_update_workspaces(mawim_t *mawim);
 
 /**
- * @brief searches all workspaces for the given X11 window.
+ * @brief Redistributes the windows of a workspace over its rows according to
+ * max_cols and max_rows, keeping their order. The workspace is marked dirty.
+ * @param mawim The mawim instance
+ * @param workspace The workspace to be reflowed
+ */
+void mawim_reflow_workspace(mawim_t *mawim, mawimctl_workspaceid_t workspace);
+
+/**
+ * @brief Marks the specified workspace as in need of a layout pass. The pass
+ * itself is done by mawim_commit_workspaces().
+ */
+void mawim_mark_workspace_dirty(mawim_t *mawim,
+                                mawimctl_workspaceid_t workspace);
+
+/**
+ * @brief Updates every dirty workspace and flushes the resulting requests
+ * to the X server once. Called once per main loop iteration.
+ */
+void mawim_commit_workspaces(mawim_t *mawim);
+
+/**
+ * @brief searches all workspaces for the given X11 window. This is a constant
+ * time lookup through the window index.
  *
  * @param mawim The mawim instance to operate on
  * @param x11_window The X11 window to search with